@@ -0,0 +1,58 @@
+#include "framebuffer.hpp"
+#include "image_renderer.hpp"
+#include "scenes.hpp"
+
+#include <benchmark/benchmark.h>
+
+namespace raytracing::bench {
+namespace {
+/*
+ * \brief Renders a whole draw_sphere() frame, counting pixels as items.
+ * Arguments: the seed of the scene, the number of small spheres, and the
+ * number of threads, 0 for one per core.
+ */
+void BM_RenderFrame(benchmark::State &state) {
+	const Rect dimension{320, 240};
+	Scene scene = make_draw_sphere_scene(dimension,
+										 static_cast<uint64_t>(state.range(0)),
+										 static_cast<size_t>(state.range(1)));
+	scene.renderer.build_bvh();
+	if (state.range(2) > 0)
+		scene.renderer.set_thread_count(static_cast<size_t>(state.range(2)));
+
+	for (auto _ : state)
+		benchmark::DoNotOptimize(scene.renderer.render(scene.viewport,
+													   dimension));
+	state.SetItemsProcessed(
+		static_cast<int64_t>(state.iterations() * dimension.area()));
+}
+BENCHMARK(BM_RenderFrame)
+	->ArgsProduct({{1, 2}, {5, 500}, {1, 0}})
+	->ArgNames({"seed", "small_spheres", "threads"})
+	->Unit(benchmark::kMillisecond)
+	->UseRealTime();
+
+/*
+ * \brief Renders a draw_sphere() frame scaled up to a million small spheres
+ * in view on every core, counting pixels as items. Argument: the BvhLayout
+ * as an integer.
+ */
+void BM_RenderBvhLayout(benchmark::State &state) {
+	const Rect dimension{320, 240};
+	Scene scene = make_sphere_field_scene(dimension, 1, 1 << 20);
+	scene.renderer.build_bvh(BvhBuilder::BINNED_SAH,
+							 static_cast<BvhLayout>(state.range(0)));
+
+	for (auto _ : state)
+		benchmark::DoNotOptimize(scene.renderer.render(scene.viewport,
+													   dimension));
+	state.SetItemsProcessed(
+		static_cast<int64_t>(state.iterations() * dimension.area()));
+}
+BENCHMARK(BM_RenderBvhLayout)
+	->DenseRange(0, 2)
+	->ArgName("layout")
+	->Unit(benchmark::kMillisecond)
+	->UseRealTime();
+} // namespace
+} // namespace raytracing::bench
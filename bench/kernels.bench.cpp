@@ -0,0 +1,232 @@
+#include "bvh.hpp"
+#include "color.hpp"
+#include "geometric.hpp"
+#include "material.hpp"
+#include "random.hpp"
+#include "ray.hpp"
+#include "solid_object_list.hpp"
+#include "sphere.hpp"
+#include "viewport.hpp"
+
+#include <benchmark/benchmark.h>
+#include <cmath>
+#include <memory>
+#include <vector>
+
+namespace raytracing::bench {
+namespace {
+// Enough inputs to defeat the branch predictor, few enough to stay in cache
+constexpr size_t INPUT_COUNT = 1024;
+constexpr uint64_t SEED      = 2024;
+
+std::vector<Vector3f> make_unit_vectors(Rng &rng) {
+	std::vector<Vector3f> vectors(INPUT_COUNT);
+	for (auto &v : vectors) v = random_unit_vector(rng);
+	return vectors;
+}
+
+std::vector<Ray> make_rays(Rng &rng, float extent) {
+	std::vector<Ray> rays(INPUT_COUNT);
+	for (auto &ray : rays)
+		ray = {random_vector(rng, -extent, extent), random_unit_vector(rng)};
+	return rays;
+}
+
+// The normal of the surface facing each incident vector
+std::vector<Vector3f>
+make_facing_normals(const std::vector<Vector3f> &incidents, Rng &rng) {
+	std::vector<Vector3f> normals = make_unit_vectors(rng);
+	for (size_t i = 0; i < normals.size(); ++i)
+		if (normals[i].dot(incidents[i]) > 0) normals[i] = -normals[i];
+	return normals;
+}
+
+void BM_SphereHit(benchmark::State &state) {
+	Rng rng{SEED};
+	const Sphere sphere{Point3f::Zero(), Material{}, 2};
+	const auto rays = make_rays(rng, 4);
+
+	size_t i = 0;
+	for (auto _ : state) {
+		benchmark::DoNotOptimize(sphere.hit(rays[i]));
+		i = (i + 1) % rays.size();
+	}
+	state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_SphereHit);
+
+void BM_Reflect(benchmark::State &state) {
+	Rng rng{SEED};
+	const auto incidents = make_unit_vectors(rng);
+	const auto normals   = make_facing_normals(incidents, rng);
+
+	size_t i = 0;
+	for (auto _ : state) {
+		benchmark::DoNotOptimize(reflect(incidents[i], normals[i]));
+		i = (i + 1) % incidents.size();
+	}
+	state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_Reflect);
+
+void BM_Refract(benchmark::State &state) {
+	Rng rng{SEED};
+	const auto incidents = make_unit_vectors(rng);
+	const auto normals   = make_facing_normals(incidents, rng);
+
+	size_t i = 0;
+	for (auto _ : state) {
+		benchmark::DoNotOptimize(refract(incidents[i], normals[i], 1 / 1.5f));
+		i = (i + 1) % incidents.size();
+	}
+	state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_Refract);
+
+void BM_Reflectance(benchmark::State &state) {
+	Rng rng{SEED};
+	const auto incidents = make_unit_vectors(rng);
+	const auto normals   = make_facing_normals(incidents, rng);
+
+	size_t i = 0;
+	for (auto _ : state) {
+		benchmark::DoNotOptimize(reflectance(incidents[i], normals[i], 1.5f));
+		i = (i + 1) % incidents.size();
+	}
+	state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_Reflectance);
+
+void BM_ToRgb(benchmark::State &state) {
+	Rng rng{SEED};
+	std::vector<ScaledColor> colors(INPUT_COUNT);
+	for (auto &color : colors) color = random_vector(rng, 0, 1.2f);
+	const float screen_gamma = static_cast<float>(state.range(0)) / 10;
+
+	size_t i = 0;
+	for (auto _ : state) {
+		benchmark::DoNotOptimize(to_rgb(colors[i], screen_gamma));
+		i = (i + 1) % colors.size();
+	}
+	state.SetItemsProcessed(state.iterations());
+}
+// The screen gamma times 10, 1 skips the gamma correction in effect
+BENCHMARK(BM_ToRgb)->Arg(10)->Arg(22);
+
+void BM_ViewportAt(benchmark::State &state) {
+	const Viewport vp{Vector3f{0.01f, 0, 0},
+					  Vector3f{0, -0.01f, 0},
+					  Point3f{-5, 5, -1}};
+	size_t i = 0, j = 0;
+	for (auto _ : state) {
+		benchmark::DoNotOptimize(
+			vp.at(static_cast<float>(i), static_cast<float>(j)));
+		if (++i == 1000) {
+			i = 0;
+			j = (j + 1) % 1000;
+		}
+	}
+	state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_ViewportAt);
+
+/*
+ * \brief Arguments: the number of spheres, and 0 to test every sphere or 1
+ * plus the BvhLayout as an integer to search through a BVH.
+ */
+void BM_FindClosestIntersection(benchmark::State &state) {
+	const auto count   = static_cast<size_t>(state.range(0));
+	const bool use_bvh = state.range(1) != 0;
+
+	Rng rng{SEED};
+	// The density of spheres stays the same whatever their number
+	const float extent = 2.f * std::cbrt(static_cast<float>(count));
+	SolidObjectList world;
+	for (size_t i = 0; i < count; ++i)
+		world.emplace<Sphere>(random_vector(rng, -extent, extent),
+							  Material{},
+							  rng.uniform(0.1f, 1.f));
+	if (use_bvh)
+		world.build_bvh(BvhBuilder::BINNED_SAH,
+						static_cast<BvhLayout>(state.range(1) - 1));
+	const auto rays = make_rays(rng, extent);
+
+	size_t i = 0;
+	for (auto _ : state) {
+		benchmark::DoNotOptimize(world.find_closest_intersection(rays[i]));
+		i = (i + 1) % rays.size();
+	}
+	state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_FindClosestIntersection)
+	->ArgsProduct({benchmark::CreateRange(8, 8 << 12, 8), {0, 1, 2, 3}})
+	->ArgNames({"spheres", "bvh"});
+
+/*
+ * \brief Arguments: the number of spheres, and the BvhBuilder as an integer.
+ */
+void BM_BuildBvh(benchmark::State &state) {
+	const auto count   = static_cast<size_t>(state.range(0));
+	const auto builder = static_cast<BvhBuilder>(state.range(1));
+
+	Rng rng{SEED};
+	const float extent = 2.f * std::cbrt(static_cast<float>(count));
+	std::vector<Sphere> spheres;
+	spheres.reserve(count);
+	for (size_t i = 0; i < count; ++i)
+		spheres.emplace_back(random_vector(rng, -extent, extent),
+							 Material{},
+							 rng.uniform(0.1f, 1.f));
+	std::vector<const SolidObject *> solids;
+	for (const auto &sphere : spheres) solids.push_back(&sphere);
+
+	for (auto _ : state) benchmark::DoNotOptimize(Bvh{solids, builder});
+	state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_BuildBvh)
+	->ArgsProduct({{1 << 12, 1 << 16, 1 << 20}, {0, 1, 2}})
+	->ArgNames({"spheres", "builder"})
+	->Unit(benchmark::kMillisecond)
+	->UseRealTime();
+
+/*
+ * \brief Moves every sphere between two frames, then brings the BVH up to
+ * date. Arguments: the number of spheres, and 1 to refit the BVH rather than
+ * build it again.
+ */
+void BM_UpdateBvh(benchmark::State &state) {
+	const auto count = static_cast<size_t>(state.range(0));
+	const bool refit = state.range(1) != 0;
+
+	Rng rng{SEED};
+	const float extent = 2.f * std::cbrt(static_cast<float>(count));
+	SolidObjectList world;
+	std::vector<Vector3f> steps(count);
+	for (size_t i = 0; i < count; ++i) {
+		world.emplace<Sphere>(random_vector(rng, -extent, extent),
+							  Material{},
+							  rng.uniform(0.1f, 1.f));
+		steps[i] = 0.1f * random_unit_vector(rng);
+	}
+	world.build_bvh();
+
+	// Every sphere swings back and forth along its step
+	float scale = 1.f;
+	for (auto _ : state) {
+		for (size_t id = 0; id < count; ++id)
+			world.transform(id, [&](SolidObject &solid) {
+				solid.translate(scale * steps[id]);
+			});
+		if (refit) world.refit_bvh();
+		else world.build_bvh();
+		scale = -scale;
+	}
+	state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_UpdateBvh)
+	->ArgsProduct({{1 << 12, 1 << 16, 1 << 20}, {0, 1}})
+	->ArgNames({"spheres", "refit"})
+	->Unit(benchmark::kMillisecond)
+	->UseRealTime();
+} // namespace
+} // namespace raytracing::bench
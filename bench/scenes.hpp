@@ -0,0 +1,96 @@
+#ifndef BENCH_SCENES_HPP
+#define BENCH_SCENES_HPP
+
+#include "camera.hpp"
+#include "image_renderer.hpp"
+#include "light_source.hpp"
+#include "material.hpp"
+#include "quantity.hpp"
+#include "random.hpp"
+#include "rect.hpp"
+#include "sphere.hpp"
+#include "viewport.hpp"
+
+#include <cmath>
+#include <cstdint>
+
+namespace raytracing::bench {
+/**
+ * \brief A scene ready to render, with the camera it is seen from.
+ */
+struct Scene {
+	Rect dimension;
+	Viewport viewport;
+	ImageRenderer renderer;
+};
+
+/**
+ * \brief Returns the scene of draw_sphere(): a ground, two large spheres, and
+ * \a small_count small glass spheres scattered at random.
+ *
+ * The small spheres are placed from \a seed, so a seed always gives the same
+ * scene.
+ */
+inline Scene make_draw_sphere_scene(Rect dimension, uint64_t seed,
+									size_t small_count = 5) {
+	using mp_units::angular::unit_symbols::deg;
+
+	Camera cam;
+	cam.perspective(20.f * deg, dimension.aspect_ratio(), 0.1f, 10.f);
+	cam.set_position(Point3f{13, 2, 3});
+	cam.update_view_matrix();
+
+	Scene scene{dimension,
+				cam.set_viewport(dimension),
+				ImageRenderer{cam.orig(), 1, 5}};
+	ImageRenderer &r = scene.renderer;
+	r.emplace<Sphere>(Point3f{0, -100, 0},
+					  Material{ScaledColor(0, 0.3, 0.5), 1, 0, 1.3},
+					  100);
+
+	Rng rng{seed};
+	for (size_t a = 1; a <= small_count; ++a) {
+		const auto spread = static_cast<float>(a);
+		r.emplace<Sphere>(random_vector(rng, -spread, spread),
+						  Material{ScaledColor{0.2, 0.3, 0.4}, 0.2, 0.7, 1.4},
+						  0.2);
+	}
+
+	r.emplace<Sphere>(Point3f{-4, 1, 0},
+					  Material{ScaledColor(1, 0, 0.2), 0.5, 0.7, 1.8},
+					  1.0);
+	r.emplace<Sphere>(Point3f{5, 1, 0},
+					  Material{ScaledColor(0.5, 0.6, 0.8), 0.3, 0.65, 1.6},
+					  1.0);
+	r.set_light_sources({LightSource{Point3f{0, 5, 0}, ScaledColor{1, 1, 1}}});
+	r.set_seed(seed);
+	return scene;
+}
+
+/**
+ * \brief Returns the scene of draw_sphere() with \a count more glass spheres
+ * scattered at random over the ground in front of the camera.
+ *
+ * However many they are, they fill the same field, 8% of it, their radius
+ * shrinking as their count grows, so that the rays keep going through many
+ * levels of the BVH.
+ */
+inline Scene make_sphere_field_scene(Rect dimension, uint64_t seed,
+									 size_t count) {
+	Scene scene = make_draw_sphere_scene(dimension, seed);
+	const Vector3f lower{-6, 0, -4};
+	const Vector3f upper{6, 2, 4};
+	const float spacing = std::cbrt((upper - lower).prod()
+									/ static_cast<float>(count));
+
+	Rng rng{seed};
+	for (size_t a = 0; a < count; ++a)
+		scene.renderer.emplace<Sphere>(
+			lower
+				+ random_vector(rng, 0.f, 1.f).cwiseProduct(upper - lower),
+			Material{ScaledColor{0.2, 0.3, 0.4}, 0.2, 0.7, 1.4},
+			0.27f * spacing);
+	return scene;
+}
+} // namespace raytracing::bench
+#endif /* ifndef BENCH_SCENES_HPP */
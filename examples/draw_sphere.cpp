@@ -1,10 +1,13 @@
 #include "camera.hpp"
 #include "color.hpp"
+#include "cost_map.hpp"
 #include "example.hpp"
+#include "image_encoder.hpp"
 #include "material.hpp"
 #include "quantity.hpp"
 #include "random.hpp"
 #include "rect.hpp"
+#include "render_stats.hpp"
 #include "sphere.hpp"
 #include "viewport.hpp"
 
@@ -48,6 +51,13 @@ void draw_sphere() {
 
 	/* r.set_light_sources({LightSource{Point3f{0, 5, 0}, ScaledColor{1, 0,
 	 * 0}}}); */
-	r.save_image("sphere.ppm", vp, dimension);
+	r.build_bvh();
+	RenderStats stats;
+	CostMap cost{dimension, CostMetric::INTERSECTION_TESTS};
+	const Framebuffer image = r.render(vp, dimension, cost, &stats);
+	write_ppm("sphere.ppm", image);
+	write_png("sphere.png", image);
+	write_png("sphere_cost.png", to_false_color(cost));
+	write_json("sphere_stats.json", stats);
 }
 } // namespace raytracing
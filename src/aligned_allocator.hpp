@@ -0,0 +1,48 @@
+#ifndef ALIGNED_ALLOCATOR_HPP
+#define ALIGNED_ALLOCATOR_HPP
+
+#include <cstddef>
+#include <new>
+#include <vector>
+
+namespace raytracing {
+/**
+ * \brief An allocator aligning every array to \a Alignment bytes, a cache
+ * line by default, so that SIMD kernels can use aligned loads on any lane
+ * width up to AVX-512.
+ */
+template <class T, size_t Alignment = 64>
+struct AlignedAllocator {
+	using value_type = T;
+
+	template <class U>
+	struct rebind {
+		using other = AlignedAllocator<U, Alignment>;
+	};
+
+	AlignedAllocator() = default;
+
+	template <class U>
+	constexpr explicit AlignedAllocator(
+		const AlignedAllocator<U, Alignment> & /*other*/) noexcept {}
+
+	[[nodiscard]] T *allocate(size_t n) {
+		return static_cast<T *>(
+			::operator new(n * sizeof(T), std::align_val_t{Alignment}));
+	}
+
+	void deallocate(T *p, size_t /*n*/) noexcept {
+		::operator delete(p, std::align_val_t{Alignment});
+	}
+
+	template <class U>
+	constexpr bool
+	operator==(const AlignedAllocator<U, Alignment> & /*other*/) const {
+		return true;
+	}
+};
+
+template <class T, size_t Alignment = 64>
+using AlignedVector = std::vector<T, AlignedAllocator<T, Alignment>>;
+} // namespace raytracing
+#endif /* ifndef ALIGNED_ALLOCATOR_HPP */
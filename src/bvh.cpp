@@ -0,0 +1,1189 @@
+#include "bvh.hpp"
+
+#include "thread_pool.hpp"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cmath>
+#include <gsl/gsl-lite.hpp>
+#include <limits>
+#include <numeric>
+#include <spdlog/spdlog.h>
+#include <spdlog/stopwatch.h>
+#include <string_view>
+
+#if defined(__AVX__) || defined(__SSE2__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+namespace raytracing {
+namespace {
+// Relative costs of visiting a node and of calling SolidObject::hit()
+constexpr float TRAVERSAL_COST    = 1.f;
+constexpr float INTERSECTION_COST = 1.f;
+
+constexpr size_t MAX_LEAF_SIZE = 4;
+// Past this many objects, a node is split even if SAH prefers a leaf
+constexpr size_t MAX_FORCED_LEAF_SIZE = 64;
+
+// Deeper than this, nodes are split at the median, which bounds the height of
+// the tree well below the size of the traversal stack.
+constexpr size_t MAX_SAH_DEPTH  = 64;
+constexpr size_t MAX_STACK_SIZE = 128;
+
+constexpr float INF = std::numeric_limits<float>::infinity();
+
+// 1 + 2 * gamma(3) from "Robust BVH Ray Traversal" (Ize, 2013)
+constexpr float EXIT_PADDING
+	= 1.f + 2.f * 3.f * std::numeric_limits<float>::epsilon();
+
+constexpr size_t BIN_COUNT = 16;
+
+// Below this many primitives, a loop is not worth sharing between threads
+constexpr size_t MIN_CHUNK_SIZE = 4096;
+// A node of this many primitives, or fewer, is built by a single task
+constexpr size_t MIN_TASK_SIZE    = 1024;
+constexpr size_t TASKS_PER_THREAD = 4;
+
+// The Morton codes of the LBVH take this many bits per axis
+constexpr unsigned MORTON_BITS = 10;
+constexpr unsigned RADIX_BITS  = 8;
+constexpr size_t RADIX         = size_t{1} << RADIX_BITS;
+
+/*
+ * \brief The handful of operations on \a N floats the slab test of a wide
+ * node needs, one lane at a time without SIMD.
+ *
+ * min() and max() return \a b when either is NaN, like SSE and AVX do.
+ */
+template <size_t N> struct Lanes {
+	using Float = std::array<float, N>;
+
+	static Float load(const float *p) {
+		Float a;
+		std::copy_n(p, N, a.begin());
+		return a;
+	}
+	static Float broadcast(float x) {
+		Float a;
+		a.fill(x);
+		return a;
+	}
+	static Float sub(const Float &a, const Float &b) {
+		return apply(a, b, [](float x, float y) { return x - y; });
+	}
+	static Float mul(const Float &a, const Float &b) {
+		return apply(a, b, [](float x, float y) { return x * y; });
+	}
+	static Float min(const Float &a, const Float &b) {
+		return apply(a, b, [](float x, float y) { return x < y ? x : y; });
+	}
+	static Float max(const Float &a, const Float &b) {
+		return apply(a, b, [](float x, float y) { return x > y ? x : y; });
+	}
+	// One bit per lane where a <= b
+	static uint32_t less_equal(const Float &a, const Float &b) {
+		uint32_t bits = 0;
+		for (size_t i = 0; i < N; ++i)
+			if (a[i] <= b[i]) bits |= 1U << i;
+		return bits;
+	}
+	static void store(float *p, const Float &a) {
+		std::copy_n(a.begin(), N, p);
+	}
+
+private:
+	template <class Op>
+	static Float apply(const Float &a, const Float &b, Op op) {
+		Float c;
+		for (size_t i = 0; i < N; ++i) c[i] = op(a[i], b[i]);
+		return c;
+	}
+};
+
+#if defined(__SSE2__)
+template <> struct Lanes<4> {
+	using Float = __m128;
+
+	static Float load(const float *p) { return _mm_load_ps(p); }
+	static Float broadcast(float x) { return _mm_set1_ps(x); }
+	static Float sub(Float a, Float b) { return _mm_sub_ps(a, b); }
+	static Float mul(Float a, Float b) { return _mm_mul_ps(a, b); }
+	static Float min(Float a, Float b) { return _mm_min_ps(a, b); }
+	static Float max(Float a, Float b) { return _mm_max_ps(a, b); }
+	static uint32_t less_equal(Float a, Float b) {
+		return static_cast<uint32_t>(_mm_movemask_ps(_mm_cmple_ps(a, b)));
+	}
+	static void store(float *p, Float a) { _mm_storeu_ps(p, a); }
+};
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+template <> struct Lanes<4> {
+	using Float = float32x4_t;
+
+	static Float load(const float *p) { return vld1q_f32(p); }
+	static Float broadcast(float x) { return vdupq_n_f32(x); }
+	static Float sub(Float a, Float b) { return vsubq_f32(a, b); }
+	static Float mul(Float a, Float b) { return vmulq_f32(a, b); }
+	// vminq_f32() and vmaxq_f32() would return NaN rather than b
+	static Float min(Float a, Float b) {
+		return vbslq_f32(vcltq_f32(a, b), a, b);
+	}
+	static Float max(Float a, Float b) {
+		return vbslq_f32(vcgtq_f32(a, b), a, b);
+	}
+	static uint32_t less_equal(Float a, Float b) {
+		static constexpr uint32_t BITS[] = {1, 2, 4, 8};
+		return vaddvq_u32(vandq_u32(vcleq_f32(a, b), vld1q_u32(BITS)));
+	}
+	static void store(float *p, Float a) { vst1q_f32(p, a); }
+};
+#endif
+
+#if defined(__AVX__)
+template <> struct Lanes<8> {
+	using Float = __m256;
+
+	static Float load(const float *p) { return _mm256_load_ps(p); }
+	static Float broadcast(float x) { return _mm256_set1_ps(x); }
+	static Float sub(Float a, Float b) { return _mm256_sub_ps(a, b); }
+	static Float mul(Float a, Float b) { return _mm256_mul_ps(a, b); }
+	static Float min(Float a, Float b) { return _mm256_min_ps(a, b); }
+	static Float max(Float a, Float b) { return _mm256_max_ps(a, b); }
+	static uint32_t less_equal(Float a, Float b) {
+		return static_cast<uint32_t>(
+			_mm256_movemask_ps(_mm256_cmp_ps(a, b, _CMP_LE_OQ)));
+	}
+	static void store(float *p, Float a) { _mm256_storeu_ps(p, a); }
+};
+#endif
+
+template <class WideNode>
+void set_slot(WideNode &node, size_t i, const Eigen::AlignedBox3f &bounds) {
+	node.min_x[i] = bounds.min().x();
+	node.min_y[i] = bounds.min().y();
+	node.min_z[i] = bounds.min().z();
+	node.max_x[i] = bounds.max().x();
+	node.max_y[i] = bounds.max().y();
+	node.max_z[i] = bounds.max().z();
+}
+
+template <class WideNode>
+Eigen::AlignedBox3f slot_bounds(const WideNode &node, size_t i) {
+	return {Point3f{node.min_x[i], node.min_y[i], node.min_z[i]},
+			Point3f{node.max_x[i], node.max_y[i], node.max_z[i]}};
+}
+
+// The NaN bounds of an empty slot of a wide node
+template <class WideNode> bool is_empty_slot(const WideNode &node, size_t i) {
+	return std::isnan(node.min_x[i]);
+}
+
+// A ray broadcast to every lane, for the slab tests of a whole traversal
+template <size_t N> struct WideRay {
+	using L = Lanes<N>;
+	typename L::Float origin_x, origin_y, origin_z;
+	typename L::Float inv_x, inv_y, inv_z;
+
+	explicit WideRay(const Ray &ray)
+		: origin_x(L::broadcast(ray.origin.x())),
+		  origin_y(L::broadcast(ray.origin.y())),
+		  origin_z(L::broadcast(ray.origin.z())),
+		  inv_x(L::broadcast(1.f / ray.direction.x())),
+		  inv_y(L::broadcast(1.f / ray.direction.y())),
+		  inv_z(L::broadcast(1.f / ray.direction.z())) {}
+
+	/**
+	 * \brief Stores in \a entries the root at which the ray enters every box
+	 * of \a bounds, and returns one bit per box entered before \a limit.
+	 *
+	 * Like entry_root(), with the root clamped to 0 and NaN bounds never
+	 * entered.
+	 */
+	template <class Bounds>
+	uint32_t enter(const Bounds &bounds, float limit, float *entries) const {
+		const auto slab = [](const float *min, const float *max,
+							 typename L::Float origin, typename L::Float inv,
+							 typename L::Float &near, typename L::Float &far) {
+			const auto t0 = L::mul(L::sub(L::load(min), origin), inv);
+			const auto t1 = L::mul(L::sub(L::load(max), origin), inv);
+			near          = L::min(t0, t1);
+			far           = L::max(t0, t1);
+		};
+		typename L::Float near_x, far_x, near_y, far_y, near_z, far_z;
+		slab(bounds.min_x.data(), bounds.max_x.data(), origin_x, inv_x,
+			 near_x, far_x);
+		slab(bounds.min_y.data(), bounds.max_y.data(), origin_y, inv_y,
+			 near_y, far_y);
+		slab(bounds.min_z.data(), bounds.max_z.data(), origin_z, inv_z,
+			 near_z, far_z);
+
+		// The NaN of an empty slot, the second operand of every max(),
+		// reaches the comparison, which fails
+		const auto near = L::max(L::broadcast(0.f),
+								 L::max(near_x, L::max(near_y, near_z)));
+		const auto exit = L::mul(L::min(far_x, L::min(far_y, far_z)),
+								 L::broadcast(EXIT_PADDING));
+		const auto far  = L::min(exit, L::broadcast(limit));
+		L::store(entries, near);
+		return L::less_equal(near, far);
+	}
+};
+
+size_t chunk_count(size_t count, const ThreadPool *pool) {
+	if (pool == nullptr) return 1;
+	return std::clamp<size_t>(count / MIN_CHUNK_SIZE,
+							  1,
+							  TASKS_PER_THREAD * pool->size());
+}
+
+/**
+ * \brief Calls \a task with every chunk of [0, count) in \a chunks about equal
+ * ones, on \a pool if there is more than one.
+ *
+ * The chunks are always the same for the same \a count and \a chunks.
+ */
+void for_each_chunk(ThreadPool *pool, size_t count, size_t chunks,
+					const std::function<void(size_t chunk, size_t first,
+											 size_t last)> &task) {
+	const auto run = [&](size_t chunk) {
+		task(chunk, count * chunk / chunks, count * (chunk + 1) / chunks);
+	};
+	if (chunks == 1) run(0);
+	else pool->parallel_for(chunks, run);
+}
+
+// Interleaves the lowest MORTON_BITS bits of \a v with two zero bits each
+uint32_t spread_bits(uint32_t v) {
+	v = (v * 0x00010001U) & 0xFF0000FFU;
+	v = (v * 0x00000101U) & 0x0F00F00FU;
+	v = (v * 0x00000011U) & 0xC30C30C3U;
+	v = (v * 0x00000005U) & 0x49249249U;
+	return v;
+}
+
+// Returns the Morton code of \a unit, a point of the unit cube
+uint32_t morton_code(const Eigen::Array3f &unit) {
+	constexpr auto CELLS = static_cast<float>(1U << MORTON_BITS);
+	const Eigen::Array3f cell = (unit * CELLS).min(CELLS - 1.f).max(0.f);
+	return (spread_bits(static_cast<uint32_t>(cell.x())) << 2)
+		 | (spread_bits(static_cast<uint32_t>(cell.y())) << 1)
+		 | spread_bits(static_cast<uint32_t>(cell.z()));
+}
+
+/**
+ * \brief Sorts \a keys by a stable least significant digit radix sort, every
+ * pass counting and scattering its chunks on \a pool in parallel, and returns
+ * where every key was.
+ */
+std::vector<uint32_t> radix_sort(std::vector<uint32_t> &keys,
+								 ThreadPool &pool) {
+	const size_t count  = keys.size();
+	const size_t chunks = chunk_count(count, &pool);
+	std::vector<uint32_t> order(count);
+	std::iota(order.begin(), order.end(), 0U);
+	std::vector<uint32_t> sorted_keys(count), sorted_order(count);
+	std::vector<std::array<size_t, RADIX>> offsets(chunks);
+
+	for (unsigned shift = 0; shift < 3 * MORTON_BITS; shift += RADIX_BITS) {
+		const auto digit = [shift](uint32_t key) {
+			return (key >> shift) & (RADIX - 1);
+		};
+		for_each_chunk(&pool, count, chunks, [&](size_t c, size_t i, size_t n) {
+			offsets[c].fill(0);
+			for (; i < n; ++i) ++offsets[c][digit(keys[i])];
+		});
+
+		// Every digit in order, and within a digit every chunk in order
+		size_t offset = 0;
+		for (size_t d = 0; d < RADIX; ++d)
+			for (auto &chunk : offsets)
+				offset += std::exchange(chunk[d], offset);
+
+		for_each_chunk(&pool, count, chunks, [&](size_t c, size_t i, size_t n) {
+			for (; i < n; ++i) {
+				const size_t to  = offsets[c][digit(keys[i])]++;
+				sorted_keys[to]  = keys[i];
+				sorted_order[to] = order[i];
+			}
+		});
+		keys.swap(sorted_keys);
+		order.swap(sorted_order);
+	}
+	return order;
+}
+} // namespace
+
+std::string_view to_string(BvhBuilder builder) {
+	switch (builder) {
+	case BvhBuilder::SWEEP_SAH: return "sweep SAH";
+	case BvhBuilder::BINNED_SAH: return "binned SAH";
+	case BvhBuilder::LBVH: return "linear";
+	}
+	return "";
+}
+
+std::string_view to_string(BvhLayout layout) {
+	switch (layout) {
+	case BvhLayout::BINARY: return "binary";
+	case BvhLayout::BVH4: return "4-wide";
+	case BvhLayout::BVH8: return "8-wide";
+	}
+	return "";
+}
+
+float surface_area(const Eigen::AlignedBox3f &box) {
+	if (box.isEmpty()) return 0.f;
+	const Vector3f d = box.sizes();
+	return 2.f * (d.x() * d.y() + d.y() * d.z() + d.z() * d.x());
+}
+
+float entry_root(const Eigen::AlignedBox3f &box, const Ray &ray,
+				 Vector3fConstRef inv_direction) {
+	const Eigen::Array3f t0
+		= (box.min() - ray.origin).array() * inv_direction.array();
+	const Eigen::Array3f t1
+		= (box.max() - ray.origin).array() * inv_direction.array();
+
+	const float near = t0.min(t1).maxCoeff();
+	const float far  = t0.max(t1).minCoeff() * EXIT_PADDING;
+	if (near > far || far < 0.f) return INF;
+	return near;
+}
+
+Bvh::Bvh(std::span<const SolidObject *const> solids, BvhBuilder builder,
+		 BvhLayout layout, size_t thread_count)
+	: builder_(builder), layout_(layout) {
+	spdlog::stopwatch sw;
+	ThreadPool pool{thread_count};
+	const size_t count = solids.size();
+	primitives_.resize(count);
+	for_each_chunk(&pool,
+				   count,
+				   chunk_count(count, &pool),
+				   [&](size_t, size_t i, size_t n) {
+					   for (; i < n; ++i) {
+						   const auto bounds = solids[i]->bounding_box();
+						   primitives_[i]
+							   = {solids[i], i, bounds, bounds.center()};
+					   }
+				   });
+	if (primitives_.empty()) return;
+
+	std::unique_ptr<BuildNode> root;
+	switch (builder) {
+	case BvhBuilder::SWEEP_SAH: root = build_sweep(0, count, 0); break;
+	case BvhBuilder::BINNED_SAH:
+		root = build_tasks(pool,
+						   [this](size_t first, size_t last, size_t depth,
+								  ThreadPool *workers) {
+							   return split_binned(first,
+												   last,
+												   depth,
+												   workers);
+						   });
+		break;
+	case BvhBuilder::LBVH: root = build_lbvh(pool); break;
+	}
+
+	finish(*root);
+	switch (layout) {
+	case BvhLayout::BINARY:
+		// Every pair of siblings starts on an even node, i.e. a cache line
+		nodes_.reserve(node_count_ + 1);
+		nodes_.resize(2);
+		flatten(*root, 0);
+		break;
+	case BvhLayout::BVH4:
+		nodes4_.resize(1);
+		collapse(*root, 0, nodes4_);
+		node_count_ = nodes4_.size();
+		break;
+	case BvhLayout::BVH8:
+		nodes8_.resize(1);
+		collapse(*root, 0, nodes8_);
+		node_count_ = nodes8_.size();
+		break;
+	}
+	objects_.reserve(count);
+	for (const auto &primitive : primitives_)
+		objects_.push_back({primitive.solid, primitive.index});
+	primitives_ = {};
+
+	visit_nodes([this, count](const auto &nodes) {
+		parents_.assign(nodes.size(), 0);
+		depths_.assign(nodes.size(), 0);
+		dirty_.assign(nodes.size(), false);
+		leaf_of_.resize(count);
+		link(nodes);
+		for (size_t index = 0; index < nodes.size(); ++index)
+			total_cost_ += node_cost(nodes, index);
+	});
+	normalize_cost();
+	built_sah_cost_ = sah_cost_;
+
+	spdlog::debug("Built a {} {} BVH of {} nodes over {} objects in {} "
+				 "seconds, SAH cost {:.2f}",
+				 to_string(builder),
+				 to_string(layout),
+				 node_count_,
+				 count,
+				 sw,
+				 sah_cost_);
+}
+
+std::unique_ptr<Bvh::BuildNode> Bvh::build_sweep(size_t first, size_t last,
+												 size_t depth) {
+	auto node = std::make_unique<BuildNode>();
+
+	const auto range = std::span{primitives_}.subspan(first, last - first);
+	for (const auto &primitive : range) node->bounds.extend(primitive.bounds);
+
+	const size_t count = range.size();
+	if (count <= MAX_LEAF_SIZE) {
+		node->first = first;
+		node->count = count;
+		return node;
+	}
+
+	const auto by_centroid = [](int axis) {
+		return [axis](const Primitive &lhs, const Primitive &rhs) {
+			return lhs.centroid[axis] < rhs.centroid[axis];
+		};
+	};
+
+	// Sweep every axis for the partition of the sorted primitives with the
+	// lowest SAH cost.
+	int best_axis      = -1;
+	size_t best_split  = count / 2;
+	float best_cost    = INF;
+	const float parent = surface_area(node->bounds);
+	std::vector<float> right_area(count);
+
+	for (int axis = 0; depth < MAX_SAH_DEPTH && axis < 3; ++axis) {
+		std::ranges::sort(range, by_centroid(axis));
+
+		Eigen::AlignedBox3f right;
+		for (size_t i = count; i-- > 1;) {
+			right.extend(range[i].bounds);
+			right_area[i] = surface_area(right);
+		}
+
+		Eigen::AlignedBox3f left;
+		for (size_t i = 1; i < count; ++i) {
+			left.extend(range[i - 1].bounds);
+			const float cost = TRAVERSAL_COST
+							   + INTERSECTION_COST
+									 * (surface_area(left) * i
+										+ right_area[i] * (count - i))
+									 / parent;
+			if (cost < best_cost) {
+				best_cost  = cost;
+				best_axis  = axis;
+				best_split = i;
+			}
+		}
+	}
+
+	const float leaf_cost = INTERSECTION_COST * count;
+	if (best_cost >= leaf_cost && count <= MAX_FORCED_LEAF_SIZE) {
+		node->first = first;
+		node->count = count;
+		return node;
+	}
+
+	if (best_axis < 0 || best_cost >= leaf_cost) {
+		// Median split along the widest spread of centroids
+		Eigen::AlignedBox3f centroids;
+		for (const auto &primitive : range)
+			centroids.extend(primitive.centroid);
+		centroids.sizes().maxCoeff(&best_axis);
+		best_split = count / 2;
+		std::ranges::nth_element(range,
+								 range.begin() + best_split,
+								 by_centroid(best_axis));
+	} else if (best_axis != 2) {
+		std::ranges::sort(range, by_centroid(best_axis));
+	}
+
+	node->left  = build_sweep(first, first + best_split, depth + 1);
+	node->right = build_sweep(first + best_split, last, depth + 1);
+	return node;
+}
+
+std::optional<size_t> Bvh::split_binned(size_t first, size_t last,
+										size_t depth, ThreadPool *pool) {
+	const size_t count = last - first;
+	if (count <= MAX_LEAF_SIZE) return std::nullopt;
+	const auto range    = std::span{primitives_}.subspan(first, count);
+	const size_t chunks = chunk_count(count, pool);
+
+	std::vector<Eigen::AlignedBox3f> chunk_centroids(chunks);
+	for_each_chunk(pool, count, chunks, [&](size_t c, size_t i, size_t n) {
+		for (; i < n; ++i) chunk_centroids[c].extend(range[i].centroid);
+	});
+	Eigen::AlignedBox3f centroids;
+	for (const auto &box : chunk_centroids) centroids.extend(box);
+	const Vector3f extent = centroids.sizes();
+
+	const auto bin_of = [&](const Primitive &primitive, int axis) {
+		const float offset = primitive.centroid[axis] - centroids.min()[axis];
+		return std::min(BIN_COUNT - 1,
+						static_cast<size_t>(BIN_COUNT * offset / extent[axis]));
+	};
+
+	struct Bin {
+		Eigen::AlignedBox3f bounds;
+		size_t count = 0;
+	};
+	using Bins = std::array<std::array<Bin, BIN_COUNT>, 3>;
+	std::vector<Bins> chunk_bins(chunks);
+	for_each_chunk(pool, count, chunks, [&](size_t c, size_t i, size_t n) {
+		for (; i < n; ++i)
+			for (int axis = 0; axis < 3; ++axis) {
+				if (!(extent[axis] > 0.f)) continue;
+				Bin &bin = chunk_bins[c][axis][bin_of(range[i], axis)];
+				bin.bounds.extend(range[i].bounds);
+				++bin.count;
+			}
+	});
+	Bins bins;
+	for (const auto &chunk : chunk_bins)
+		for (int axis = 0; axis < 3; ++axis)
+			for (size_t b = 0; b < BIN_COUNT; ++b) {
+				bins[axis][b].bounds.extend(chunk[axis][b].bounds);
+				bins[axis][b].count += chunk[axis][b].count;
+			}
+
+	// Sweep the boundaries of the bins of every axis for the partition with
+	// the lowest SAH cost.
+	int best_axis     = -1;
+	size_t best_split = 0;
+	float best_cost   = INF;
+	for (int axis = 0; depth < MAX_SAH_DEPTH && axis < 3; ++axis) {
+		if (!(extent[axis] > 0.f)) continue;
+		const auto &axis_bins = bins[axis];
+
+		std::array<float, BIN_COUNT> right_area{};
+		Eigen::AlignedBox3f right;
+		for (size_t b = BIN_COUNT; b-- > 1;) {
+			right.extend(axis_bins[b].bounds);
+			right_area[b] = surface_area(right);
+		}
+		const float parent = surface_area(right.merged(axis_bins[0].bounds));
+
+		Eigen::AlignedBox3f left;
+		size_t left_count = 0;
+		for (size_t b = 1; b < BIN_COUNT; ++b) {
+			left.extend(axis_bins[b - 1].bounds);
+			left_count += axis_bins[b - 1].count;
+			if (left_count == 0 || left_count == count) continue;
+			const float cost = TRAVERSAL_COST
+							   + INTERSECTION_COST
+									 * (surface_area(left) * left_count
+										+ right_area[b] * (count - left_count))
+									 / parent;
+			if (cost < best_cost) {
+				best_cost  = cost;
+				best_axis  = axis;
+				best_split = b;
+			}
+		}
+	}
+
+	const float leaf_cost = INTERSECTION_COST * count;
+	if (best_cost >= leaf_cost && count <= MAX_FORCED_LEAF_SIZE)
+		return std::nullopt;
+
+	if (best_axis < 0 || best_cost >= leaf_cost) {
+		// Median split along the widest spread of centroids
+		extent.maxCoeff(&best_axis);
+		std::ranges::nth_element(range,
+								 range.begin() + count / 2,
+								 [best_axis](const Primitive &lhs,
+											 const Primitive &rhs) {
+									 return lhs.centroid[best_axis]
+										  < rhs.centroid[best_axis];
+								 });
+		return first + count / 2;
+	}
+
+	const auto right = std::partition(
+		range.begin(), range.end(), [&](const Primitive &primitive) {
+			return bin_of(primitive, best_axis) < best_split;
+		});
+	return first + static_cast<size_t>(right - range.begin());
+}
+
+std::unique_ptr<Bvh::BuildNode> Bvh::build_lbvh(ThreadPool &pool) {
+	const size_t count  = primitives_.size();
+	const size_t chunks = chunk_count(count, &pool);
+
+	std::vector<Eigen::AlignedBox3f> chunk_centroids(chunks);
+	for_each_chunk(&pool, count, chunks, [&](size_t c, size_t i, size_t n) {
+		for (; i < n; ++i) chunk_centroids[c].extend(primitives_[i].centroid);
+	});
+	Eigen::AlignedBox3f centroids;
+	for (const auto &box : chunk_centroids) centroids.extend(box);
+	// A flat axis maps every centroid to 0 rather than dividing by 0
+	const Eigen::Array3f scale
+		= centroids.sizes()
+			  .cwiseMax(std::numeric_limits<float>::min())
+			  .cwiseInverse()
+			  .array();
+
+	std::vector<uint32_t> codes(count);
+	for_each_chunk(&pool, count, chunks, [&](size_t, size_t i, size_t n) {
+		for (; i < n; ++i)
+			codes[i] = morton_code(
+				(primitives_[i].centroid - centroids.min()).array() * scale);
+	});
+
+	const auto order = radix_sort(codes, pool);
+	std::vector<Primitive> sorted(count);
+	for_each_chunk(&pool, count, chunks, [&](size_t, size_t i, size_t n) {
+		for (; i < n; ++i) sorted[i] = primitives_[order[i]];
+	});
+	primitives_.swap(sorted);
+
+	// Every node is split where the highest bit its codes differ by flips,
+	// or at the middle if they are all the same.
+	return build_tasks(
+		pool,
+		[&codes](size_t first, size_t last, size_t, ThreadPool *)
+			-> std::optional<size_t> {
+			if (last - first <= MAX_LEAF_SIZE) return std::nullopt;
+			const uint32_t bit
+				= std::bit_floor(codes[first] ^ codes[last - 1]);
+			if (bit == 0) return first + (last - first) / 2;
+			const auto right = std::partition_point(
+				codes.begin() + first,
+				codes.begin() + last,
+				[bit](uint32_t code) { return (code & bit) == 0; });
+			return static_cast<size_t>(right - codes.begin());
+		});
+}
+
+std::unique_ptr<Bvh::BuildNode> Bvh::build_tasks(ThreadPool &pool,
+												 const Splitter &split) {
+	struct Task {
+		size_t first, last, depth;
+		std::unique_ptr<BuildNode> *node;
+	};
+	const size_t task_size = std::max(
+		MIN_TASK_SIZE, primitives_.size() / (TASKS_PER_THREAD * pool.size()));
+
+	std::unique_ptr<BuildNode> root;
+	std::vector<Task> pending{{0, primitives_.size(), 0, &root}};
+	std::vector<Task> tasks;
+	while (!pending.empty()) {
+		const Task task = pending.back();
+		pending.pop_back();
+		if (task.last - task.first <= task_size) {
+			tasks.push_back(task);
+			continue;
+		}
+
+		*task.node      = std::make_unique<BuildNode>();
+		BuildNode &node = **task.node;
+		const auto mid = split(task.first, task.last, task.depth, &pool);
+		if (!mid.has_value()) {
+			make_leaf(node, task.first, task.last);
+			continue;
+		}
+		pending.push_back({task.first, *mid, task.depth + 1, &node.left});
+		pending.push_back({*mid, task.last, task.depth + 1, &node.right});
+	}
+
+	pool.parallel_for(tasks.size(), [&](size_t t) {
+		const auto &[first, last, depth, node] = tasks[t];
+		*node = build_subtree(first, last, depth, split);
+	});
+	return root;
+}
+
+std::unique_ptr<Bvh::BuildNode> Bvh::build_subtree(size_t first, size_t last,
+												   size_t depth,
+												   const Splitter &split) {
+	auto node      = std::make_unique<BuildNode>();
+	const auto mid = split(first, last, depth, nullptr);
+	if (!mid.has_value()) {
+		make_leaf(*node, first, last);
+		return node;
+	}
+	node->left  = build_subtree(first, *mid, depth + 1, split);
+	node->right = build_subtree(*mid, last, depth + 1, split);
+	return node;
+}
+
+void Bvh::make_leaf(BuildNode &node, size_t first, size_t last) const {
+	node.first = first;
+	node.count = last - first;
+	for (const auto &primitive :
+		 std::span{primitives_}.subspan(first, node.count))
+		node.bounds.extend(primitive.bounds);
+}
+
+void Bvh::finish(BuildNode &node) {
+	++node_count_;
+	if (node.is_leaf()) return;
+
+	finish(*node.left);
+	finish(*node.right);
+	node.bounds = node.left->bounds.merged(node.right->bounds);
+}
+
+void Bvh::flatten(const BuildNode &node, size_t index) {
+	nodes_[index].bounds = node.bounds;
+	if (node.is_leaf()) {
+		nodes_[index].offset = static_cast<uint32_t>(node.first);
+		nodes_[index].count  = static_cast<uint32_t>(node.count);
+		return;
+	}
+
+	const size_t children = nodes_.size();
+	nodes_.resize(children + 2);
+	nodes_[index].offset = static_cast<uint32_t>(children);
+	nodes_[index].count  = 0;
+	flatten(*node.left, children);
+	flatten(*node.right, children + 1);
+}
+
+template <size_t N>
+void Bvh::collapse(const BuildNode &node, size_t index,
+				   AlignedVector<WideNode<N>> &nodes) {
+	// Opens the inner child of largest area until there are N children, only
+	// the root may be a single leaf
+	std::array<const BuildNode *, N> children{};
+	size_t count = 0;
+	if (node.is_leaf()) {
+		children[count++] = &node;
+	} else {
+		children[count++] = node.left.get();
+		children[count++] = node.right.get();
+	}
+	while (count < N) {
+		const BuildNode **largest = nullptr;
+		float largest_area        = -1.f;
+		for (size_t i = 0; i < count; ++i) {
+			const float area = surface_area(children[i]->bounds);
+			if (!children[i]->is_leaf() && area > largest_area) {
+				largest      = &children[i];
+				largest_area = area;
+			}
+		}
+		if (largest == nullptr) break;
+		const BuildNode &opened = **largest;
+		*largest                = opened.left.get();
+		children[count++]       = opened.right.get();
+	}
+
+	constexpr float NaN = std::numeric_limits<float>::quiet_NaN();
+	WideNode<N> wide;
+	for (auto *bound : {&wide.min_x, &wide.min_y, &wide.min_z, &wide.max_x,
+						&wide.max_y, &wide.max_z})
+		bound->fill(NaN);
+	wide.offset.fill(0);
+	wide.count.fill(0);
+	for (size_t i = 0; i < count; ++i) {
+		const BuildNode &child = *children[i];
+		set_slot(wide, i, child.bounds);
+		if (child.is_leaf()) {
+			wide.offset[i] = static_cast<uint32_t>(child.first);
+			wide.count[i]  = static_cast<uint32_t>(child.count);
+		} else {
+			wide.offset[i] = static_cast<uint32_t>(nodes.size());
+			nodes.emplace_back();
+		}
+	}
+	nodes[index] = wide;
+
+	for (size_t i = 0; i < count; ++i)
+		if (!children[i]->is_leaf())
+			collapse(*children[i], wide.offset[i], nodes);
+}
+
+bool Bvh::refit(std::span<const uint32_t> moved, float max_degradation,
+				size_t thread_count) {
+	if (moved.empty() || objects_.empty()) return false;
+	spdlog::stopwatch sw;
+
+	// The nodes above the moved objects, by depth, each once
+	std::vector<std::vector<uint32_t>> levels;
+	for (const uint32_t id : moved) {
+		gsl_Expects(id < leaf_of_.size());
+		for (uint32_t index = leaf_of_[id]; !dirty_[index];
+			 index          = parents_[index]) {
+			dirty_[index]      = true;
+			const size_t depth = depths_[index];
+			if (levels.size() <= depth) levels.resize(depth + 1);
+			levels[depth].push_back(index);
+		}
+	}
+
+	// A few moved objects are fitted faster than the threads start
+	size_t widest = 0;
+	for (const auto &level : levels) widest = std::max(widest, level.size());
+	ThreadPool pool{widest < 2 * MIN_CHUNK_SIZE ? 1 : thread_count};
+
+	// Every level only reads the one below it, fitted before
+	std::vector<float> growth;
+	for (auto level = levels.rbegin(); level != levels.rend(); ++level) {
+		growth.resize(level->size());
+		for_each_chunk(&pool,
+					   level->size(),
+					   chunk_count(level->size(), &pool),
+					   [&](size_t, size_t i, size_t n) {
+						   visit_nodes([&](auto &nodes) {
+							   for (; i < n; ++i)
+								   growth[i] = refit_node(nodes, (*level)[i]);
+						   });
+					   });
+		// Summed in order, the cost does not depend on the number of threads
+		for (size_t i = 0; i < level->size(); ++i) {
+			total_cost_ += growth[i];
+			dirty_[(*level)[i]] = false;
+		}
+	}
+	normalize_cost();
+	spdlog::debug("Refitted the BVH over {} moved objects in {} seconds, SAH "
+				  "cost {:.2f}",
+				  moved.size(),
+				  sw,
+				  sah_cost_);
+	if (sah_cost_ <= max_degradation * built_sah_cost_) return false;
+
+	spdlog::info("Rebuilding the BVH, its SAH cost grew from {:.2f} to {:.2f}",
+				 built_sah_cost_,
+				 sah_cost_);
+	std::vector<const SolidObject *> solids(objects_.size());
+	for (const auto &[solid, index] : objects_) solids[index] = solid;
+	*this = Bvh{solids, builder_, layout_, thread_count};
+	return true;
+}
+
+void Bvh::link(const AlignedVector<Node> &nodes) {
+	// Walks down from the root, which skips the padding node
+	std::vector<uint32_t> pending{0};
+	while (!pending.empty()) {
+		const uint32_t index = pending.back();
+		pending.pop_back();
+		const Node &node = nodes[index];
+		if (node.is_leaf()) {
+			for (const auto &object :
+				 std::span{objects_}.subspan(node.offset, node.count))
+				leaf_of_[object.index] = index;
+			continue;
+		}
+		for (const uint32_t child : {node.offset, node.offset + 1}) {
+			parents_[child] = index;
+			depths_[child]  = static_cast<uint8_t>(depths_[index] + 1);
+			pending.push_back(child);
+		}
+	}
+}
+
+template <size_t N>
+void Bvh::link(const AlignedVector<WideNode<N>> &nodes) {
+	// Every node comes after its parent
+	for (uint32_t index = 0; index < nodes.size(); ++index) {
+		const WideNode<N> &node = nodes[index];
+		for (size_t i = 0; i < N; ++i) {
+			if (is_empty_slot(node, i)) continue;
+			if (node.count[i] == 0) {
+				parents_[node.offset[i]] = index;
+				depths_[node.offset[i]]
+					= static_cast<uint8_t>(depths_[index] + 1);
+				continue;
+			}
+			for (const auto &object :
+				 std::span{objects_}.subspan(node.offset[i], node.count[i]))
+				leaf_of_[object.index] = index;
+		}
+	}
+}
+
+float Bvh::node_cost(const AlignedVector<Node> &nodes, size_t index) {
+	const Node &node = nodes[index];
+	const float area = surface_area(node.bounds);
+	if (node.is_leaf()) return INTERSECTION_COST * node.count * area;
+	return TRAVERSAL_COST * area;
+}
+
+template <size_t N>
+float Bvh::node_cost(const AlignedVector<WideNode<N>> &nodes, size_t index) {
+	const WideNode<N> &node = nodes[index];
+	float cost = TRAVERSAL_COST * surface_area(node_bounds(nodes, index));
+	for (size_t i = 0; i < N; ++i)
+		if (!is_empty_slot(node, i) && node.count[i] > 0)
+			cost += INTERSECTION_COST * node.count[i]
+				  * surface_area(slot_bounds(node, i));
+	return cost;
+}
+
+Eigen::AlignedBox3f Bvh::node_bounds(const AlignedVector<Node> &nodes,
+									 size_t index) {
+	return nodes[index].bounds;
+}
+
+template <size_t N>
+Eigen::AlignedBox3f Bvh::node_bounds(const AlignedVector<WideNode<N>> &nodes,
+									 size_t index) {
+	Eigen::AlignedBox3f bounds;
+	for (size_t i = 0; i < N; ++i)
+		if (!is_empty_slot(nodes[index], i))
+			bounds.extend(slot_bounds(nodes[index], i));
+	return bounds;
+}
+
+float Bvh::refit_node(AlignedVector<Node> &nodes, size_t index) const {
+	const float before = node_cost(nodes, index);
+	Node &node         = nodes[index];
+	node.bounds        = node.is_leaf()
+						   ? leaf_bounds(node.offset, node.count)
+						   : nodes[node.offset].bounds.merged(
+								 nodes[node.offset + 1].bounds);
+	return node_cost(nodes, index) - before;
+}
+
+template <size_t N>
+float Bvh::refit_node(AlignedVector<WideNode<N>> &nodes, size_t index) const {
+	const float before = node_cost(nodes, index);
+	WideNode<N> &node  = nodes[index];
+	for (size_t i = 0; i < N; ++i) {
+		if (is_empty_slot(node, i)) continue;
+		set_slot(node,
+				 i,
+				 node.count[i] > 0 ? leaf_bounds(node.offset[i], node.count[i])
+								   : node_bounds(nodes, node.offset[i]));
+	}
+	return node_cost(nodes, index) - before;
+}
+
+Eigen::AlignedBox3f Bvh::leaf_bounds(uint32_t offset, uint32_t count) const {
+	Eigen::AlignedBox3f bounds;
+	for (const auto &object : std::span{objects_}.subspan(offset, count))
+		bounds.extend(object.solid->bounding_box());
+	return bounds;
+}
+
+void Bvh::normalize_cost() {
+	const float root_area = visit_nodes([](const auto &nodes) {
+		return surface_area(node_bounds(nodes, 0));
+	});
+	sah_cost_ = root_area > 0.f ? static_cast<float>(total_cost_ / root_area)
+								: 0.f;
+}
+
+std::optional<Bvh::Hit> Bvh::find_closest_hit(const Ray &ray,
+											  TraversalStats *stats) const {
+	if (layout_ == BvhLayout::BVH4)
+		return find_closest_wide(nodes4_, ray, stats);
+	if (layout_ == BvhLayout::BVH8)
+		return find_closest_wide(nodes8_, ray, stats);
+	if (nodes_.empty()) return std::nullopt;
+
+	const Vector3f inv_direction = ray.direction.cwiseInverse();
+	Hit closest{0, INF};
+	TraversalStats traversal;
+
+	std::array<std::pair<uint32_t, float>, MAX_STACK_SIZE> stack;
+	size_t size = 0;
+	if (float entry = entry_root(nodes_[0].bounds, ray, inv_direction);
+		!std::isinf(entry))
+		stack[size++] = {0, entry};
+
+	while (size > 0) {
+		const auto [index, entry] = stack[--size];
+		// The closest hit may have moved nearer since this node was pushed
+		if (entry > closest.root) continue;
+		++traversal.node_visits;
+		const Node &node = nodes_[index];
+
+		if (node.is_leaf()) {
+			traversal.primitive_tests += node.count;
+			for (const auto &[solid, object] :
+				 std::span{objects_}.subspan(node.offset, node.count)) {
+				uint32_t part    = 0;
+				const float root = solid->hit_part(ray, part, &traversal);
+				if (root < closest.root
+					|| (root == closest.root && object < closest.index))
+					closest = {object, root, part};
+			}
+			continue;
+		}
+
+		// Both children lie in the same cache line
+		uint32_t near_child = node.offset;
+		uint32_t far_child  = node.offset + 1;
+		float left  = entry_root(nodes_[near_child].bounds, ray, inv_direction);
+		float right = entry_root(nodes_[far_child].bounds, ray, inv_direction);
+		if (right < left) {
+			std::swap(left, right);
+			std::swap(near_child, far_child);
+		}
+		// Push the farther child first so that the nearer one pops first
+		if (!std::isinf(right) && !(right > closest.root))
+			stack[size++] = {far_child, right};
+		if (!std::isinf(left) && !(left > closest.root))
+			stack[size++] = {near_child, left};
+	}
+
+	if (stats != nullptr) *stats += traversal;
+	if (std::isinf(closest.root)) return std::nullopt;
+	return closest;
+}
+
+bool Bvh::is_occluded(const Ray &ray, float t_max,
+					  TraversalStats *stats) const {
+	if (layout_ == BvhLayout::BVH4)
+		return is_occluded_wide(nodes4_, ray, t_max, stats);
+	if (layout_ == BvhLayout::BVH8)
+		return is_occluded_wide(nodes8_, ray, t_max, stats);
+	if (nodes_.empty()) return false;
+
+	TraversalStats traversal;
+	const auto report = [&](bool occluded) {
+		if (stats != nullptr) *stats += traversal;
+		return occluded;
+	};
+
+	const Vector3f inv_direction = ray.direction.cwiseInverse();
+	const auto is_crossed = [&](uint32_t index) {
+		const float entry
+			= entry_root(nodes_[index].bounds, ray, inv_direction);
+		return !std::isinf(entry) && entry < t_max;
+	};
+
+	std::array<uint32_t, MAX_STACK_SIZE> stack;
+	size_t size = 0;
+	if (is_crossed(0)) stack[size++] = 0;
+
+	while (size > 0) {
+		const Node &node = nodes_[stack[--size]];
+		++traversal.node_visits;
+
+		if (node.is_leaf()) {
+			for (const auto &object :
+				 std::span{objects_}.subspan(node.offset, node.count)) {
+				++traversal.primitive_tests;
+				uint32_t part = 0;
+				if (object.solid->hit_part(ray, part, &traversal) < t_max)
+					return report(true);
+			}
+			continue;
+		}
+
+		if (is_crossed(node.offset + 1)) stack[size++] = node.offset + 1;
+		if (is_crossed(node.offset)) stack[size++] = node.offset;
+	}
+	return report(false);
+}
+
+template <size_t N>
+std::optional<Bvh::Hit>
+Bvh::find_closest_wide(const AlignedVector<WideNode<N>> &nodes, const Ray &ray,
+					   TraversalStats *stats) const {
+	if (nodes.empty()) return std::nullopt;
+
+	const WideRay<N> wide_ray{ray};
+	Hit closest{0, INF};
+	TraversalStats traversal;
+
+	// A wide node if count is 0, a leaf otherwise
+	struct Entry {
+		uint32_t offset, count;
+		float root;
+	};
+	std::array<Entry, MAX_STACK_SIZE *(N - 1)> stack;
+	size_t size   = 0;
+	stack[size++] = {0, 0, 0.f};
+
+	while (size > 0) {
+		const Entry entry = stack[--size];
+		// The closest hit may have moved nearer since this node was pushed
+		if (entry.root > closest.root) continue;
+		++traversal.node_visits;
+
+		if (entry.count > 0) {
+			traversal.primitive_tests += entry.count;
+			for (const auto &[solid, object] :
+				 std::span{objects_}.subspan(entry.offset, entry.count)) {
+				uint32_t part    = 0;
+				const float root = solid->hit_part(ray, part, &traversal);
+				if (root < closest.root
+					|| (root == closest.root && object < closest.index))
+					closest = {object, root, part};
+			}
+			continue;
+		}
+
+		const WideNode<N> &node = nodes[entry.offset];
+		alignas(64) std::array<float, N> entries;
+		uint32_t entered = wide_ray.enter(node, closest.root, entries.data());
+
+		// Sorted farthest first, so that the nearest child pops first
+		std::array<Entry, N> children;
+		size_t count = 0;
+		for (; entered != 0; entered &= entered - 1) {
+			const auto i = static_cast<size_t>(std::countr_zero(entered));
+			Entry child{node.offset[i], node.count[i], entries[i]};
+			size_t k = count++;
+			for (; k > 0 && children[k - 1].root < child.root; --k)
+				children[k] = children[k - 1];
+			children[k] = child;
+		}
+		std::copy_n(children.begin(), count, stack.begin() + size);
+		size += count;
+	}
+
+	if (stats != nullptr) *stats += traversal;
+	if (std::isinf(closest.root)) return std::nullopt;
+	return closest;
+}
+
+template <size_t N>
+bool Bvh::is_occluded_wide(const AlignedVector<WideNode<N>> &nodes,
+						   const Ray &ray, float t_max,
+						   TraversalStats *stats) const {
+	if (nodes.empty()) return false;
+
+	TraversalStats traversal;
+	const auto report = [&](bool occluded) {
+		if (stats != nullptr) *stats += traversal;
+		return occluded;
+	};
+
+	const WideRay<N> wide_ray{ray};
+	std::array<uint32_t, MAX_STACK_SIZE *(N - 1)> stack;
+	size_t size   = 0;
+	stack[size++] = 0;
+
+	while (size > 0) {
+		const WideNode<N> &node = nodes[stack[--size]];
+		++traversal.node_visits;
+
+		alignas(64) std::array<float, N> entries;
+		for (uint32_t entered = wide_ray.enter(node, t_max, entries.data());
+			 entered != 0;
+			 entered &= entered - 1) {
+			const auto i = static_cast<size_t>(std::countr_zero(entered));
+			if (node.count[i] == 0) {
+				stack[size++] = node.offset[i];
+				continue;
+			}
+			++traversal.node_visits;
+			for (const auto &object :
+				 std::span{objects_}.subspan(node.offset[i], node.count[i])) {
+				++traversal.primitive_tests;
+				uint32_t part = 0;
+				if (object.solid->hit_part(ray, part, &traversal) < t_max)
+					return report(true);
+			}
+		}
+	}
+	return report(false);
+}
+} // namespace raytracing
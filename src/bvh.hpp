@@ -0,0 +1,355 @@
+#ifndef BVH_HPP
+#define BVH_HPP
+
+#include "aligned_allocator.hpp"
+#include "ray.hpp"
+#include "render_stats.hpp"
+#include "solid_object.hpp"
+
+#include <Eigen/Geometry>
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+namespace raytracing {
+class ThreadPool;
+
+/**
+ * \brief How a Bvh is split, trading the time to build it for the time to
+ * trace rays through it.
+ */
+enum class BvhBuilder {
+	// Sorts every node along every axis for the exact SAH split, on a single
+	// thread: the best trees, the slowest to build
+	SWEEP_SAH,
+	// Evaluates the SAH at the boundaries of a few bins per axis, the
+	// subtrees built in parallel: nearly as good trees, much faster
+	BINNED_SAH,
+	// Sorts the objects along a Morton curve with a parallel radix sort and
+	// splits where the codes differ: the fastest to build, the worst trees
+	LBVH
+};
+
+/**
+ * \brief How the nodes of a Bvh are laid out in memory once it is built.
+ */
+enum class BvhLayout {
+	// Two children per node, one box tested at a time
+	BINARY,
+	// Four children per node, their boxes tested at once with SSE or NEON
+	BVH4,
+	// Eight children per node, their boxes tested at once with AVX
+	BVH8
+};
+
+// Names the builder or the layout of a Bvh in the log
+[[nodiscard]] std::string_view to_string(BvhBuilder builder);
+[[nodiscard]] std::string_view to_string(BvhLayout layout);
+
+/**
+ * \brief A bounding volume hierarchy over the bounding boxes of the solid
+ * objects of a scene.
+ *
+ * The tree is split as the BvhBuilder tells, by the surface area heuristic
+ * (SAH) by default: at every node, the partition minimising the expected cost
+ * of a ray query is chosen, so a ray only calls SolidObject::hit() on the
+ * handful of objects along its way.
+ *
+ * Once built, the tree is flattened into an array of 32-byte nodes in
+ * depth-first order, the two children of every node sharing a cache line,
+ * and the leaves index a compact array of the objects directly. The wide
+ * layouts rather collapse the tree into nodes of 4 or 8 children whose boxes
+ * are kept as a structure of arrays, so that a ray enters all of them with a
+ * single SIMD slab test and visits them nearest first.
+ *
+ * \warning The tree keeps non-owning pointers to the objects, it must be
+ * rebuilt whenever one of them is added, removed or moved.
+ */
+class Bvh {
+public:
+	// Past this ratio of the SAH cost as built, refit() rebuilds the tree
+	static constexpr float DEFAULT_MAX_DEGRADATION = 1.5f;
+
+	struct Hit {
+		size_t index; // of the solid object in the span the tree is built from
+		float root;
+		uint32_t part = 0; // See SolidObject::hit_part()
+	};
+
+	/**
+	 * \brief Builds the tree on \a thread_count threads, the calling one
+	 * included, and logs at debug level the time it took and its SAH cost.
+	 *
+	 * The tree does not depend on the number of threads.
+	 */
+	explicit Bvh(std::span<const SolidObject *const> solids,
+				 BvhBuilder builder  = BvhBuilder::BINNED_SAH,
+				 BvhLayout layout    = BvhLayout::BINARY,
+				 size_t thread_count = std::max(
+					 1U, std::thread::hardware_concurrency()));
+
+	/**
+	 * \brief Returns the closest intersection of \a ray with any object.
+	 *
+	 * Gives exactly the same result as calling hit() on every object and
+	 * keeping the smallest root, the first object winning ties.
+	 *
+	 * \param stats If not null, receives the nodes visited and the objects
+	 * tested.
+	 */
+	[[nodiscard]] std::optional<Hit>
+	find_closest_hit(const Ray &ray, TraversalStats *stats = nullptr) const;
+
+	/**
+	 * \brief Returns true if \a ray hits any object at a root less than \a
+	 * t_max.
+	 *
+	 * Unlike find_closest_hit(), the traversal stops at the first such hit
+	 * and never enters a box farther than \a t_max, which is all a shadow ray
+	 * needs to know.
+	 */
+	[[nodiscard]] bool is_occluded(const Ray &ray, float t_max,
+								   TraversalStats *stats = nullptr) const;
+
+	/**
+	 * \brief Fits the boxes of the nodes above the objects at the indices \a
+	 * moved again, bottom-up one level at a time on \a thread_count threads,
+	 * without changing which objects every leaf holds.
+	 *
+	 * The more the objects move away from their neighbours, the more the
+	 * boxes overlap: once sah_cost() exceeds \a max_degradation times the
+	 * cost as built, the tree is rebuilt with the same builder and layout.
+	 *
+	 * \return true if the tree was rebuilt.
+	 */
+	bool refit(std::span<const uint32_t> moved,
+			   float max_degradation = DEFAULT_MAX_DEGRADATION,
+			   size_t thread_count   = std::max(
+				   1U, std::thread::hardware_concurrency()));
+
+	// The nodes of the tree as laid out, padding excluded
+	[[nodiscard]] size_t node_count() const { return node_count_; }
+
+	[[nodiscard]] BvhLayout layout() const { return layout_; }
+
+	/**
+	 * \brief Returns the expected cost of the closest hit of a random ray
+	 * through the root of the tree as laid out and last refitted, in units
+	 * of SolidObject::hit(), the lower the better.
+	 */
+	[[nodiscard]] float sah_cost() const { return sah_cost_; }
+
+	// Returns sah_cost() as it was when the tree was built
+	[[nodiscard]] float built_sah_cost() const { return built_sah_cost_; }
+
+private:
+	struct Primitive {
+		const SolidObject *solid;
+		size_t index;
+		Eigen::AlignedBox3f bounds;
+		Point3f centroid;
+	};
+
+	// A node of the tree while it is built, see Node for the final one
+	struct BuildNode {
+		Eigen::AlignedBox3f bounds;
+		std::unique_ptr<BuildNode> left, right;
+		// The range of primitives_ in a leaf, both children are null
+		size_t first = 0, count = 0;
+
+		[[nodiscard]] bool is_leaf() const { return !left; }
+	};
+
+	/**
+	 * \brief A node of the flattened tree, two of which fill a cache line.
+	 *
+	 * The children of an inner node are stored side by side in one cache
+	 * line, both boxes being tested together, and the pairs follow each
+	 * other in depth-first order.
+	 */
+	struct Node {
+		Eigen::AlignedBox3f bounds;
+		// The first of the two children of an inner node, or the first
+		// object of a leaf
+		uint32_t offset;
+		// The objects of a leaf, 0 for an inner node
+		uint32_t count;
+
+		[[nodiscard]] bool is_leaf() const { return count > 0; }
+	};
+	static_assert(sizeof(Node) == 32);
+
+	/**
+	 * \brief A node of a wide layout, the bounds of its \a N children kept
+	 * one array per coordinate for the SIMD slab test.
+	 *
+	 * A child is a leaf if its count is not 0, an empty slot has NaN bounds
+	 * that no ray ever enters.
+	 */
+	template <size_t N> struct alignas(64) WideNode {
+		std::array<float, N> min_x, min_y, min_z, max_x, max_y, max_z;
+		// The index of an inner child in the nodes, or the first object of a
+		// leaf
+		std::array<uint32_t, N> offset;
+		std::array<uint32_t, N> count;
+	};
+
+	// What a leaf needs of a primitive to test it
+	struct Object {
+		const SolidObject *solid;
+		size_t index;
+	};
+
+	/**
+	 * \brief Partitions the primitives of [first, last) and returns where
+	 * those of the right child start, or nothing for a leaf.
+	 *
+	 * \param pool The threads to share the work of a large node with, null
+	 * within the task building a subtree.
+	 */
+	using Splitter = std::function<std::optional<size_t>(
+		size_t first, size_t last, size_t depth, ThreadPool *pool)>;
+
+	std::unique_ptr<BuildNode> build_sweep(size_t first, size_t last,
+										   size_t depth);
+
+	std::optional<size_t> split_binned(size_t first, size_t last,
+									   size_t depth, ThreadPool *pool);
+
+	// Sorts the primitives along the Morton curve, then builds the tree
+	std::unique_ptr<BuildNode> build_lbvh(ThreadPool &pool);
+
+	/**
+	 * \brief Splits the nodes too large for a single task on the calling
+	 * thread, sharing each split with \a pool, then builds the subtrees left
+	 * as parallel tasks.
+	 */
+	std::unique_ptr<BuildNode> build_tasks(ThreadPool &pool,
+										   const Splitter &split);
+
+	std::unique_ptr<BuildNode> build_subtree(size_t first, size_t last,
+											 size_t depth,
+											 const Splitter &split);
+
+	void make_leaf(BuildNode &node, size_t first, size_t last) const;
+
+	// Fits the bounds of every inner node to its children, counts the nodes
+	void finish(BuildNode &node);
+
+	// Copies \a node to nodes_[index] and its subtree after the end of nodes_
+	void flatten(const BuildNode &node, size_t index);
+
+	/**
+	 * \brief Collapses \a node and its descendants into \a nodes [index],
+	 * its inner children after the end of \a nodes.
+	 */
+	template <size_t N>
+	static void collapse(const BuildNode &node, size_t index,
+						 AlignedVector<WideNode<N>> &nodes);
+
+	// Calls \a visit with the nodes of the layout, whatever their type
+	template <class Visit> decltype(auto) visit_nodes(Visit &&visit) {
+		switch (layout_) {
+		case BvhLayout::BVH4: return visit(nodes4_);
+		case BvhLayout::BVH8: return visit(nodes8_);
+		default: return visit(nodes_);
+		}
+	}
+
+	// Fills parents_, depths_ and leaf_of_ from the nodes as laid out
+	void link(const AlignedVector<Node> &nodes);
+	template <size_t N> void link(const AlignedVector<WideNode<N>> &nodes);
+
+	/**
+	 * \brief Returns the share of the node at \a index in the cost of the
+	 * tree, before it is divided by the area of the root.
+	 */
+	[[nodiscard]] static float node_cost(const AlignedVector<Node> &nodes,
+										 size_t index);
+	template <size_t N>
+	[[nodiscard]] static float
+	node_cost(const AlignedVector<WideNode<N>> &nodes, size_t index);
+
+	[[nodiscard]] static Eigen::AlignedBox3f
+	node_bounds(const AlignedVector<Node> &nodes, size_t index);
+	template <size_t N>
+	[[nodiscard]] static Eigen::AlignedBox3f
+	node_bounds(const AlignedVector<WideNode<N>> &nodes, size_t index);
+
+	/**
+	 * \brief Fits the node at \a index to its children, already fitted, and
+	 * returns how much its share of the cost grew.
+	 */
+	float refit_node(AlignedVector<Node> &nodes, size_t index) const;
+	template <size_t N>
+	float refit_node(AlignedVector<WideNode<N>> &nodes, size_t index) const;
+
+	// The box of the objects [offset, offset + count) where they are now
+	[[nodiscard]] Eigen::AlignedBox3f leaf_bounds(uint32_t offset,
+												  uint32_t count) const;
+
+	// Sets sah_cost_ from total_cost_ and the area of the root
+	void normalize_cost();
+
+	template <size_t N>
+	[[nodiscard]] std::optional<Hit>
+	find_closest_wide(const AlignedVector<WideNode<N>> &nodes, const Ray &ray,
+					  TraversalStats *stats) const;
+
+	template <size_t N>
+	[[nodiscard]] bool is_occluded_wide(const AlignedVector<WideNode<N>> &nodes,
+										const Ray &ray, float t_max,
+										TraversalStats *stats) const;
+
+	// Emptied once the tree is built
+	std::vector<Primitive> primitives_;
+	std::vector<Object> objects_;
+	// The root first, then a padding node aligning every pair of siblings
+	AlignedVector<Node> nodes_;
+	// The root first, for BvhLayout::BVH4 and BVH8 respectively
+	AlignedVector<WideNode<4>> nodes4_;
+	AlignedVector<WideNode<8>> nodes8_;
+	BvhBuilder builder_;
+	BvhLayout layout_;
+	size_t node_count_ = 0;
+
+	// The parent of every node as laid out, the root being its own
+	std::vector<uint32_t> parents_;
+	std::vector<uint8_t> depths_;
+	// Marks the nodes met by refit() on the way up, cleared once fitted
+	std::vector<bool> dirty_;
+	// The node holding every object, by its index in the span of the solids
+	std::vector<uint32_t> leaf_of_;
+
+	// The sum of node_cost() over every node
+	double total_cost_    = 0.0;
+	float sah_cost_       = 0.f;
+	float built_sah_cost_ = 0.f;
+};
+
+/**
+ * \brief Returns the parametric root at which \a ray enters \a box, or
+ * infinity if it misses the box.
+ *
+ * \param inv_direction The component-wise inverse of the ray direction,
+ * computed once per ray rather than per box.
+ *
+ * \note The exit root is padded by a few ulps so that a surface lying exactly
+ * on a face of its box is never culled because of rounding errors.
+ */
+[[nodiscard]] float entry_root(const Eigen::AlignedBox3f &box, const Ray &ray,
+							   Vector3fConstRef inv_direction);
+
+/**
+ * \brief Returns the surface area of \a box, 0 if it is empty.
+ */
+[[nodiscard]] float surface_area(const Eigen::AlignedBox3f &box);
+} // namespace raytracing
+#endif /* ifndef BVH_HPP */
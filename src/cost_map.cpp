@@ -0,0 +1,43 @@
+#include "cost_map.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+
+namespace raytracing {
+namespace {
+// A heat palette evenly spread over [0, 1]
+const std::array<ScaledColor, 5> PALETTE{ScaledColor{0, 0, 0},
+										 ScaledColor{0, 0, 1},
+										 ScaledColor{1, 0, 0},
+										 ScaledColor{1, 1, 0},
+										 ScaledColor{1, 1, 1}};
+
+ScaledColor false_color(float t) {
+	const float x       = std::clamp(t, 0.f, 1.f) * (PALETTE.size() - 1);
+	const auto low      = static_cast<size_t>(x);
+	const size_t high   = std::min(low + 1, PALETTE.size() - 1);
+	const float between = x - static_cast<float>(low);
+	return PALETTE[low] * (1 - between) + PALETTE[high] * between;
+}
+} // namespace
+
+CostMap::CostMap(Rect dimension, CostMetric metric)
+	: dimension_(dimension), metric_(metric), costs_(dimension.area(), 0.f) {}
+
+float CostMap::max() const {
+	if (costs_.empty()) return 0.f;
+	return std::ranges::max(costs_);
+}
+
+Framebuffer to_false_color(const CostMap &cost, float max_cost) {
+	if (max_cost <= 0.f) max_cost = cost.max();
+
+	Framebuffer image{cost.dimension()};
+	for (size_t j = 0; j < cost.dimension().height; ++j)
+		for (size_t i = 0; i < cost.dimension().width; ++i)
+			image.at(i, j) = false_color(
+				max_cost > 0.f ? cost.at(i, j) / max_cost : 0.f);
+	return image;
+}
+} // namespace raytracing
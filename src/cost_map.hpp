@@ -0,0 +1,64 @@
+#ifndef COST_MAP_HPP
+#define COST_MAP_HPP
+
+#include "framebuffer.hpp"
+#include "rect.hpp"
+
+#include <span>
+#include <vector>
+
+namespace raytracing {
+/**
+ * \brief What the cost of tracing a pixel is measured in.
+ */
+enum class CostMetric {
+	// Ray-box and ray-object intersection tests, the same on every run
+	INTERSECTION_TESTS,
+	// Nanoseconds, but every pixel has to be traced on its own to be timed
+	TIME,
+};
+
+/**
+ * \brief The cost of tracing every pixel of an image, in row-major order,
+ * to find the regions that make a frame slow.
+ */
+class CostMap {
+public:
+	CostMap(Rect dimension, CostMetric metric);
+
+	[[nodiscard]] Rect dimension() const { return dimension_; }
+
+	[[nodiscard]] CostMetric metric() const { return metric_; }
+
+	[[nodiscard]] float &at(size_t i, size_t j) {
+		return costs_[j * dimension_.width + i];
+	}
+
+	[[nodiscard]] float at(size_t i, size_t j) const {
+		return costs_[j * dimension_.width + i];
+	}
+
+	[[nodiscard]] std::span<const float> costs() const { return costs_; }
+
+	[[nodiscard]] float max() const;
+
+private:
+	Rect dimension_;
+	CostMetric metric_;
+	std::vector<float> costs_;
+};
+
+/**
+ * \brief Returns a false-color image of \a cost, black for no cost through
+ * blue, red and yellow to white for \a max_cost and above.
+ *
+ * The image goes through the same encoders as any rendered one, e.g. next to
+ * the beauty image with write_png().
+ *
+ * \param max_cost The cost shown in white, the highest one in \a cost if 0,
+ * fix it to compare several images.
+ */
+[[nodiscard]] Framebuffer to_false_color(const CostMap &cost,
+										 float max_cost = 0.f);
+} // namespace raytracing
+#endif /* ifndef COST_MAP_HPP */
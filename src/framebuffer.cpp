@@ -0,0 +1,7 @@
+#include "framebuffer.hpp"
+
+namespace raytracing {
+Framebuffer::Framebuffer(Rect dimension)
+	: dimension_(dimension),
+	  pixels_(dimension.area(), ScaledColor::Zero()) {}
+} // namespace raytracing
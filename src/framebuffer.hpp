@@ -0,0 +1,48 @@
+#ifndef FRAMEBUFFER_HPP
+#define FRAMEBUFFER_HPP
+
+#include "color.hpp"
+#include "rect.hpp"
+
+#include <span>
+#include <vector>
+
+namespace raytracing {
+/**
+ * \brief A rendered image holding one linear (not gamma corrected) float RGB
+ * color per pixel in row-major order.
+ *
+ * Rendering once into a Framebuffer lets any number of encoders, with any
+ * screen gamma, write the same image without tracing the scene again.
+ */
+class Framebuffer {
+public:
+	explicit Framebuffer(Rect dimension);
+
+	[[nodiscard]] Rect dimension() const { return dimension_; }
+
+	[[nodiscard]] ScaledColor &at(size_t i, size_t j) {
+		return pixels_[j * dimension_.width + i];
+	}
+
+	[[nodiscard]] const ScaledColor &at(size_t i, size_t j) const {
+		return pixels_[j * dimension_.width + i];
+	}
+
+	[[nodiscard]] std::span<const ScaledColor> row(size_t j) const {
+		return std::span{pixels_}.subspan(j * dimension_.width,
+										  dimension_.width);
+	}
+
+	[[nodiscard]] const std::vector<ScaledColor> &pixels() const {
+		return pixels_;
+	}
+
+	bool operator==(const Framebuffer &other) const = default;
+
+private:
+	Rect dimension_;
+	std::vector<ScaledColor> pixels_;
+};
+} // namespace raytracing
+#endif /* ifndef FRAMEBUFFER_HPP */
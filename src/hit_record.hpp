@@ -0,0 +1,45 @@
+#ifndef HIT_RECORD_HPP
+#define HIT_RECORD_HPP
+
+#include "intersection.hpp"
+#include "ray.hpp"
+#include "solid_object.hpp"
+
+#include <cstdint>
+#include <limits>
+
+namespace raytracing {
+/**
+ * \brief The compact result of a closest-hit search.
+ *
+ * Only the parametric root and the object are recorded, the position and the
+ * surface normal are left to to_intersection(), which runs once per ray
+ * rather than once per candidate object.
+ */
+struct HitRecord {
+	float root         = std::numeric_limits<float>::infinity();
+	uint32_t object_id = std::numeric_limits<uint32_t>::max();
+	// The part of the object hit, see SolidObject::hit_part()
+	uint32_t part = 0;
+	// Set once the search is over, from the index of the object in its
+	// SolidObjectList
+	const SolidObject *solid = nullptr;
+
+	/**
+	 * \brief Records the hit of the part \a other_part of the object \a id at
+	 * \a other_root if it is closer, the object inserted first winning ties.
+	 */
+	void keep_closest(float other_root, uint32_t id, uint32_t other_part = 0) {
+		if (other_root < root || (other_root == root && id < object_id)) {
+			root      = other_root;
+			object_id = id;
+			part      = other_part;
+		}
+	}
+
+	[[nodiscard]] Intersection to_intersection(const Ray &ray) const {
+		return solid->intersection_at(ray, root, part);
+	}
+};
+} // namespace raytracing
+#endif /* ifndef HIT_RECORD_HPP */
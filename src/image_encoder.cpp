@@ -0,0 +1,295 @@
+#include "image_encoder.hpp"
+
+#include "thread_pool.hpp"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstdint>
+#include <cstdlib>
+#include <fmt/format.h>
+#include <gsl/gsl-lite.hpp>
+#include <iterator>
+#include <span>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+#include <zlib.h>
+
+namespace raytracing {
+namespace {
+// Flush the binary output in blocks of at least this many bytes
+constexpr size_t WRITE_BLOCK_SIZE = size_t{1} << 20;
+
+// The rows of every band write_png() compresses on its own
+constexpr size_t PNG_BAND_HEIGHT = 32;
+constexpr std::array<uint8_t, 8> PNG_SIGNATURE{137, 80, 78, 71, 13, 10, 26, 10};
+// A zlib stream of a 32 KiB window deflated at the default level
+constexpr std::array<uint8_t, 2> ZLIB_HEADER{0x78, 0x9c};
+constexpr size_t RGB_BYTES = 3;
+
+fmt::file create_binary_file(fmt::cstring_view filename) {
+	return {filename,
+			fmt::file::WRONLY | fmt::file::CREATE | fmt::file::TRUNC};
+}
+
+void write_all(fmt::file &file, std::span<const uint8_t> bytes) {
+	while (!bytes.empty())
+		bytes = bytes.subspan(file.write(bytes.data(), bytes.size()));
+}
+
+void write_ascii_ppm(fmt::cstring_view filename, const Framebuffer &image,
+					 float screen_gamma) {
+	const auto [width, height] = image.dimension();
+
+	auto out = fmt::output_file(filename);
+	out.print("P3\n{} {}\n255\n", width, height);
+	for (const auto &color : image.pixels()) print(out, color, screen_gamma);
+}
+
+void write_binary_ppm(fmt::cstring_view filename, const Framebuffer &image,
+					  float screen_gamma) {
+	const auto [width, height] = image.dimension();
+	auto file                  = create_binary_file(filename);
+
+	std::vector<uint8_t> buffer;
+	buffer.reserve(WRITE_BLOCK_SIZE + 3 * width);
+	fmt::format_to(std::back_inserter(buffer),
+				   "P6\n{} {}\n255\n",
+				   width,
+				   height);
+
+	for (size_t j = 0; j < height; ++j) {
+		for (const auto &color : image.row(j)) {
+			const auto final = to_rgb(color, screen_gamma);
+			buffer.insert(buffer.end(), final.begin(), final.end());
+		}
+		if (buffer.size() >= WRITE_BLOCK_SIZE) {
+			write_all(file, buffer);
+			buffer.clear();
+		}
+	}
+	write_all(file, buffer);
+}
+
+void append_u32(std::vector<uint8_t> &bytes, uint32_t value) {
+	// PNG stores every integer big-endian
+	for (int shift = 24; shift >= 0; shift -= 8)
+		bytes.push_back(static_cast<uint8_t>(value >> shift));
+}
+
+/**
+ * \brief Returns the byte predicted by the PNG \a filter from the byte on
+ * the left \a a, the one above \a b and the one above on the left \a c.
+ */
+uint8_t predict(uint8_t filter, uint8_t a, uint8_t b, uint8_t c) {
+	switch (filter) {
+	case 1: return a;
+	case 2: return b;
+	case 3: return static_cast<uint8_t>((a + b) / 2);
+	case 4: {
+		const int p  = a + b - c;
+		const int pa = std::abs(p - a);
+		const int pb = std::abs(p - b);
+		const int pc = std::abs(p - c);
+		if (pa <= pb && pa <= pc) return a;
+		return pb <= pc ? b : c;
+	}
+	default: return 0;
+	}
+}
+
+/**
+ * \brief Appends the filter byte and \a row filtered by whichever filter
+ * leaves the smallest sum of absolute differences, which tends to compress
+ * best.
+ *
+ * \param above The row above, or empty to filter without it.
+ */
+void append_filtered(std::vector<uint8_t> &out, std::span<const uint8_t> row,
+					 std::span<const uint8_t> above) {
+	const uint8_t filters = above.empty() ? 2 : 5;
+	std::vector<uint8_t> candidate(row.size());
+	std::vector<uint8_t> best;
+	uint8_t best_filter = 0;
+	uint64_t best_score = UINT64_MAX;
+
+	for (uint8_t filter = 0; filter < filters; ++filter) {
+		uint64_t score = 0;
+		for (size_t k = 0; k < row.size(); ++k) {
+			const uint8_t a = k >= RGB_BYTES ? row[k - RGB_BYTES] : 0;
+			const uint8_t b = above.empty() ? 0 : above[k];
+			const uint8_t c
+				= k >= RGB_BYTES && !above.empty() ? above[k - RGB_BYTES] : 0;
+			candidate[k]
+				= static_cast<uint8_t>(row[k] - predict(filter, a, b, c));
+			// The residue as a signed byte
+			score += std::min<unsigned>(candidate[k], 256U - candidate[k]);
+		}
+		if (score < best_score) {
+			best_score  = score;
+			best_filter = filter;
+			best.swap(candidate);
+			candidate.resize(row.size());
+		}
+	}
+
+	out.push_back(best_filter);
+	out.insert(out.end(), best.begin(), best.end());
+}
+} // namespace
+
+void write_ppm(fmt::cstring_view filename, const Framebuffer &image,
+			   float screen_gamma, PpmFormat format) {
+	switch (format) {
+	case PpmFormat::ASCII:
+		write_ascii_ppm(filename, image, screen_gamma);
+		break;
+	case PpmFormat::BINARY:
+		write_binary_ppm(filename, image, screen_gamma);
+		break;
+	}
+}
+
+void write_png(const std::string &filename, const Framebuffer &image,
+			   float screen_gamma) {
+	PngStream png{filename, image.dimension(), PNG_BAND_HEIGHT, screen_gamma};
+	ThreadPool pool{std::min<size_t>(
+		std::max(1U, std::thread::hardware_concurrency()),
+		png.band_count())};
+	pool.parallel_for(png.band_count(),
+					  [&](size_t band) { png.write_band(image, band); });
+}
+
+void write_pfm(fmt::cstring_view filename, const Framebuffer &image) {
+	static_assert(std::endian::native == std::endian::little,
+				  "PFM is written with a negative scale, i.e. little-endian");
+	static_assert(sizeof(ScaledColor) == 3 * sizeof(float));
+	const auto [width, height] = image.dimension();
+	auto file                  = create_binary_file(filename);
+
+	std::vector<uint8_t> buffer;
+	fmt::format_to(std::back_inserter(buffer),
+				   "PF\n{} {}\n-1.0\n",
+				   width,
+				   height);
+	for (size_t j = height; j-- > 0;) {
+		const auto row = std::as_bytes(image.row(j));
+		std::ranges::transform(row,
+							   std::back_inserter(buffer),
+							   [](std::byte b) { return uint8_t(b); });
+		if (buffer.size() >= WRITE_BLOCK_SIZE) {
+			write_all(file, buffer);
+			buffer.clear();
+		}
+	}
+	write_all(file, buffer);
+}
+
+PngStream::PngStream(fmt::cstring_view filename, Rect dimension,
+					 size_t band_height, float screen_gamma)
+	: file_(create_binary_file(filename)), dimension_(dimension),
+	  band_height_(band_height), screen_gamma_(screen_gamma) {
+	gsl_Expects(dimension.area() > 0 && band_height > 0);
+	pending_.resize(band_count());
+
+	write_all(file_, PNG_SIGNATURE);
+	std::vector<uint8_t> header;
+	append_u32(header, static_cast<uint32_t>(dimension.width));
+	append_u32(header, static_cast<uint32_t>(dimension.height));
+	// 8 bits per channel of RGB, deflated, filtered per row, not interlaced
+	header.insert(header.end(), {8, 2, 0, 0, 0});
+	write_chunk("IHDR", header);
+}
+
+void PngStream::write_band(const Framebuffer &image, size_t band) {
+	gsl_Expects(image.dimension() == dimension_ && band < band_count());
+	DeflatedBand deflated = deflate_band(image, band);
+
+	const std::scoped_lock lock(mutex_);
+	gsl_Expects(band >= next_band_ && !pending_[band]);
+	pending_[band] = std::move(deflated);
+	for (; next_band_ < pending_.size() && pending_[next_band_]; ++next_band_) {
+		auto &[bytes, adler, size] = *pending_[next_band_];
+		adler_ = static_cast<uint32_t>(
+			adler32_combine(adler_, adler, static_cast<z_off_t>(size)));
+		const bool last = next_band_ + 1 == pending_.size();
+		if (last) append_u32(bytes, adler_);
+		write_chunk("IDAT", bytes);
+		pending_[next_band_].reset();
+		if (last) write_chunk("IEND", {});
+	}
+}
+
+PngStream::DeflatedBand PngStream::deflate_band(const Framebuffer &image,
+												size_t band) const {
+	const size_t first = band * band_height_;
+	const size_t last  = std::min(first + band_height_, dimension_.height);
+	const size_t width = RGB_BYTES * dimension_.width;
+
+	std::vector<uint8_t> rgb;
+	rgb.reserve((last - first) * width);
+	for (size_t j = first; j < last; ++j)
+		for (const auto &color : image.row(j)) {
+			const auto final = to_rgb(color, screen_gamma_);
+			rgb.insert(rgb.end(), final.begin(), final.end());
+		}
+
+	std::vector<uint8_t> filtered;
+	filtered.reserve((last - first) * (width + 1));
+	const std::span<const uint8_t> rows{rgb};
+	for (size_t j = 0; j < last - first; ++j)
+		append_filtered(filtered,
+						rows.subspan(j * width, width),
+						j == 0 ? rows.first(0)
+							   : rows.subspan((j - 1) * width, width));
+
+	DeflatedBand result{{},
+						static_cast<uint32_t>(
+							adler32_z(1, filtered.data(), filtered.size())),
+						filtered.size()};
+	if (band == 0) result.bytes.assign(ZLIB_HEADER.begin(), ZLIB_HEADER.end());
+
+	// A raw deflate stream, the zlib header and checksum are written apart
+	z_stream zs{};
+	if (deflateInit2(&zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -MAX_WBITS, 8,
+					 Z_DEFAULT_STRATEGY)
+		!= Z_OK)
+		throw std::runtime_error("Failed to initialize the PNG deflater");
+
+	// The bound leaves room for the empty stored block of a sync flush too
+	const size_t offset = result.bytes.size();
+	result.bytes.resize(offset + deflateBound(&zs, filtered.size()) + 8);
+	zs.next_in   = filtered.data();
+	zs.avail_in  = static_cast<uInt>(filtered.size());
+	zs.next_out  = result.bytes.data() + offset;
+	zs.avail_out = static_cast<uInt>(result.bytes.size() - offset);
+
+	// Every band but the last ends on a byte boundary, not as the final block
+	const bool last_band = band + 1 == band_count();
+	const int status     = deflate(&zs, last_band ? Z_FINISH : Z_SYNC_FLUSH);
+	const bool complete  = status == (last_band ? Z_STREAM_END : Z_OK)
+						&& zs.avail_in == 0 && zs.avail_out > 0;
+	result.bytes.resize(result.bytes.size() - zs.avail_out);
+	deflateEnd(&zs);
+	if (!complete) throw std::runtime_error("Failed to deflate a PNG band");
+	return result;
+}
+
+void PngStream::write_chunk(const char (&type)[5],
+							std::span<const uint8_t> data) {
+	std::vector<uint8_t> head;
+	append_u32(head, static_cast<uint32_t>(data.size()));
+	head.insert(head.end(), type, type + 4);
+	// The CRC covers the type and the data, not the length
+	uLong crc = crc32_z(0, head.data() + 4, 4);
+	// A null buffer would reset the CRC instead, as for IEND
+	if (!data.empty()) crc = crc32_z(crc, data.data(), data.size());
+	std::vector<uint8_t> tail;
+	append_u32(tail, static_cast<uint32_t>(crc));
+
+	write_all(file_, head);
+	write_all(file_, data);
+	write_all(file_, tail);
+}
+} // namespace raytracing
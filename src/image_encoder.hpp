@@ -0,0 +1,114 @@
+#ifndef IMAGE_ENCODER_HPP
+#define IMAGE_ENCODER_HPP
+
+#include "framebuffer.hpp"
+
+#include <cstdint>
+#include <fmt/os.h>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <string>
+#include <vector>
+
+namespace raytracing {
+enum class PpmFormat {
+	ASCII, // P3, human readable decimal triplets, handy for debugging
+	BINARY // P6, one byte per component, about 4 times smaller
+};
+
+/**
+ * \brief Writes the gamma corrected \a image to the .ppm format
+ *
+ * The binary format quantizes whole rows into a byte buffer and writes it to
+ * the file in blocks of several rows.
+ *
+ * \param screen_gamma Defaults to 1 indicates no gamma correction
+ */
+void write_ppm(fmt::cstring_view filename, const Framebuffer &image,
+			   float screen_gamma = 1.f,
+			   PpmFormat format   = PpmFormat::BINARY);
+
+/**
+ * \brief Downsamples the gamma corrected \a image to 8-bit RGB values and
+ * encodes them to the .png format, its bands compressed in parallel by a
+ * PngStream.
+ *
+ * \param screen_gamma Defaults to 1 indicates no gamma correction
+ */
+void write_png(const std::string &filename, const Framebuffer &image,
+			   float screen_gamma = 1.f);
+
+/**
+ * \brief Writes the linear colors of \a image as they are, without gamma
+ * correction nor clamping, to the Portable FloatMap (.pfm) format.
+ *
+ * The rows are stored bottom to top in little-endian 32-bit floats, as the
+ * format requires.
+ */
+void write_pfm(fmt::cstring_view filename, const Framebuffer &image);
+
+/**
+ * \brief Writes an 8-bit RGB .png file band after band of rows, as soon as
+ * each of them is complete, from any number of threads at once.
+ *
+ * Every band is filtered and deflated on its own on the calling thread, its
+ * last block flushed to a byte boundary, so that the bands stitch together
+ * into a single zlib stream. The bands are written to the file in order,
+ * those compressed early are kept until every band above them is written.
+ *
+ * Splitting the stream costs a little compression, no match reaches across
+ * two bands and the first row of a band is filtered without the row above.
+ */
+class PngStream {
+public:
+	/**
+	 * \brief Creates the file and writes its header.
+	 *
+	 * \param band_height The rows of every band but the last, which may be
+	 * shorter.
+	 */
+	PngStream(fmt::cstring_view filename, Rect dimension, size_t band_height,
+			  float screen_gamma = 1.f);
+
+	[[nodiscard]] size_t band_count() const {
+		return (dimension_.height + band_height_ - 1) / band_height_;
+	}
+
+	[[nodiscard]] size_t band_height() const { return band_height_; }
+
+	/**
+	 * \brief Compresses the rows of the band \a band of \a image and writes
+	 * every band ready in order, the file is complete once each band was
+	 * written exactly once.
+	 *
+	 * The rows of \a band must not change meanwhile, the others may.
+	 */
+	void write_band(const Framebuffer &image, size_t band);
+
+private:
+	struct DeflatedBand {
+		std::vector<uint8_t> bytes;
+		// The Adler-32 checksum of the filtered rows and their length
+		uint32_t adler;
+		size_t size;
+	};
+
+	[[nodiscard]] DeflatedBand deflate_band(const Framebuffer &image,
+											size_t band) const;
+
+	void write_chunk(const char (&type)[5], std::span<const uint8_t> data);
+
+	fmt::file file_;
+	Rect dimension_;
+	size_t band_height_;
+	float screen_gamma_;
+
+	std::mutex mutex_;
+	std::vector<std::optional<DeflatedBand>> pending_;
+	size_t next_band_ = 0;
+	// The checksum of every band written so far
+	uint32_t adler_ = 1;
+};
+} // namespace raytracing
+#endif /* ifndef IMAGE_ENCODER_HPP */
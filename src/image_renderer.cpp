@@ -2,22 +2,113 @@
 
 #include "color.hpp"
 #include "geometric.hpp"
+#include "image_encoder.hpp"
+#include "optical_constants.hpp"
+#include "random.hpp"
+#include "ray_queue.hpp"
+#include "thread_pool.hpp"
+#include "tile.hpp"
 #include "viewport.hpp"
 
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cmath>
 #include <gsl/gsl-lite.hpp>
+#include <limits>
+#include <numeric>
+#include <stdexcept>
+#include <tuple>
+#include <utility>
 
 namespace raytracing {
+namespace {
+// Below this throughput, a branch survives the Russian roulette with a
+// probability proportional to its throughput
+constexpr float ROULETTE_THRESHOLD = optical::MIN_RGB_COMPONENT / 255.f;
+
+// Keeps the jitter of the samples apart from the numbers the tiles draw, with
+// the same counters
+constexpr uint64_t JITTER_STREAM = 0x9e3779b97f4a7c15;
+// And the Russian roulette apart from both
+constexpr uint64_t ROULETTE_STREAM = 0xbf58476d1ce4e5b9;
+
+// Maps a number uniformly distributed in [0, 1) to an offset from the pixel
+// center distributed as the filter
+float warp(PixelFilter filter, float u) {
+	switch (filter) {
+	case PixelFilter::BOX: return u - 0.5f;
+	case PixelFilter::TENT: {
+		// Inverse of the cumulative distribution of the tent over [-1, 1]
+		const float r = 2.f * u;
+		return r < 1.f ? std::sqrt(r) - 1.f : 1.f - std::sqrt(2.f - r);
+	}
+	}
+	return 0.f;
+}
+
+// Returns the image of \a i by a permutation of [0, length) drawn from \a
+// pattern, the hash of "Correlated Multi-Jittered Sampling" (Kensler, 2013)
+uint32_t permute(uint32_t i, uint32_t length, uint32_t pattern) {
+	// The hash permutes [0, 2^k) and values past the length walk on
+	const uint32_t mask = std::bit_ceil(length) - 1;
+	do {
+		i ^= pattern;
+		i *= 0xe170893d;
+		i ^= pattern >> 16;
+		i ^= (i & mask) >> 4;
+		i ^= pattern >> 8;
+		i *= 0x0929eb3f;
+		i ^= pattern >> 23;
+		i ^= (i & mask) >> 1;
+		i *= 1 | pattern >> 27;
+		i *= 0x6935fa69;
+		i ^= (i & mask) >> 11;
+		i *= 0x74dcb303;
+		i ^= (i & mask) >> 2;
+		i *= 0x9e501cc3;
+		i ^= (i & mask) >> 2;
+		i *= 0xc860a3df;
+		i &= mask;
+		i ^= i >> 5;
+	} while (i >= length);
+	return (i + pattern) % length;
+}
+
+// The first passes of ImageRenderer::refine() trace a ray every
+// COARSEST_BLOCK >> pass pixels each way
+constexpr uint32_t COARSEST_BLOCK = 8;
+constexpr uint32_t COARSE_PASSES  = std::bit_width(COARSEST_BLOCK);
+} // namespace
+
 ImageRenderer::ImageRenderer(Vector3fConstRef orig, float ambient_ior,
 							 uint8_t bounce_limit)
 	: ambient_ior_(ambient_ior), orig_(orig), bounce_limit_(bounce_limit) {
 	gsl_Expects(ior::MIN <= ambient_ior && ambient_ior <= ior::MAX);
-	gsl_Expects(bounce_limit < 20);
+	gsl_Expects(bounce_limit < RenderStats::MAX_DEPTH);
 }
 
 void ImageRenderer::add(std::unique_ptr<SolidObject> &&solid) {
 	world_.insert(std::move(solid));
 }
 
+void ImageRenderer::build_bvh(BvhBuilder builder, BvhLayout layout) {
+	spdlog::stopwatch sw;
+	world_.build_bvh(builder, layout, thread_count_);
+	spdlog::info("Built a {} {} BVH of {} nodes over {} objects in {} seconds, "
+				 "SAH cost {:.2f}",
+				 to_string(builder),
+				 to_string(layout),
+				 world_.bvh().node_count(),
+				 world_.size(),
+				 sw,
+				 world_.bvh().built_sah_cost());
+}
+
+bool ImageRenderer::refit_bvh(float max_degradation) {
+	return world_.refit_bvh(max_degradation, thread_count_);
+}
+
 void ImageRenderer::set_light_sources(LightSourceList &&light_source_list) {
 	light_source_list_ = std::move(light_source_list);
 }
@@ -27,46 +118,374 @@ void ImageRenderer::set_ambient_refraction(float index) {
 	ambient_ior_ = index;
 }
 
-Ray ImageRenderer::get_ray(const Viewport &viewport, size_t i, size_t j) const {
-	return standard_form_of(orig_, viewport.at(i, j), false);
+void ImageRenderer::set_thread_count(size_t thread_count) {
+	gsl_Expects(thread_count > 0);
+	thread_count_ = thread_count;
 }
 
-void ImageRenderer::save_image(fmt::cstring_view filename, const Viewport &vp,
-							   Rect dimension, float screen_gamma) {
+void ImageRenderer::set_branch_culling(BranchCulling culling) {
+	culling_ = culling;
+}
+
+void ImageRenderer::set_seed(uint64_t seed) { seed_ = seed; }
+
+void ImageRenderer::set_samples_per_pixel(uint32_t samples_per_pixel) {
+	gsl_Expects(samples_per_pixel > 0);
+	samples_per_pixel_ = samples_per_pixel;
+}
+
+void ImageRenderer::set_pixel_filter(PixelFilter filter) { filter_ = filter; }
+
+void ImageRenderer::set_adaptive_sampling(float max_error,
+										  uint32_t min_samples) {
+	gsl_Expects(max_error >= 0.f);
+	gsl_Expects(min_samples >= 2);
+	max_error_   = max_error;
+	min_samples_ = min_samples;
+}
+
+void ImageRenderer::set_tile_size(size_t tile_size) {
+	gsl_Expects(tile_size > 0);
+	tile_size_ = tile_size;
+}
+
+Ray ImageRenderer::get_ray(const Viewport &viewport, size_t i, size_t j,
+						   float du, float dv) const {
+	return standard_form_of(orig_,
+							viewport.at(static_cast<float>(i) + du,
+										static_cast<float>(j) + dv),
+							false);
+}
+
+Eigen::Vector2f ImageRenderer::subpixel_offset(uint32_t pixel,
+											   uint32_t sample) const {
+	if (samples_per_pixel_ == 1) return Eigen::Vector2f::Zero();
+
+	// Correlated multi-jittered sampling (Kensler, 2013): the n samples lie
+	// in n rows of the pixel, one each, and in distinct columns of a grid of
+	// about sqrt(n) by sqrt(n) cells, split again into as many columns as the
+	// grid has rows, whatever n
+	const uint32_t n = samples_per_pixel_;
+	const auto columns
+		= static_cast<uint32_t>(std::sqrt(static_cast<float>(n)));
+	const uint32_t rows = (n + columns - 1) / columns;
+
+	const uint32_t pattern = Rng{seed_ ^ JITTER_STREAM,
+								 pixel,
+								 std::numeric_limits<uint32_t>::max()}
+								 .next_uint();
+	// In a scrambled order, so that the first samples are spread over the
+	// whole pixel when adaptive sampling stops early
+	const uint32_t s  = permute(sample, n, pattern * 0x51633e2d);
+	const uint32_t sx = permute(s % columns, columns, pattern * 0x68bc21eb);
+	const uint32_t sy = permute(s / columns, rows, pattern * 0x02e5be93);
+
+	Rng rng{seed_ ^ JITTER_STREAM, pixel, sample};
+	const float jx = rng.next_float();
+	const float jy = rng.next_float();
+
+	// The column of the sample, then its own column within that one
+	const float x = static_cast<float>(sx)
+					+ (static_cast<float>(sy) + jx) / static_cast<float>(rows);
+	const float u = x / static_cast<float>(columns);
+	const float v = (static_cast<float>(s) + jy) / static_cast<float>(n);
+	return {warp(filter_, u), warp(filter_, v)};
+}
+
+Eigen::Vector2f ImageRenderer::progressive_offset(uint32_t pixel,
+												  uint32_t sample) const {
+	// The R2 sequence of Roberts, evenly spread however many samples are
+	// taken, shifted at random for every pixel
+	constexpr float ALPHA_U = 0.7548776662f;
+	constexpr float ALPHA_V = 0.5698402910f;
+	Rng rng{seed_ ^ JITTER_STREAM,
+			pixel,
+			std::numeric_limits<uint32_t>::max()};
+	const auto n  = static_cast<float>(sample);
+	const float u = rng.next_float() + n * ALPHA_U;
+	const float v = rng.next_float() + n * ALPHA_V;
+	return {warp(filter_, u - std::floor(u)), warp(filter_, v - std::floor(v))};
+}
+
+Framebuffer ImageRenderer::render(const Viewport &vp, Rect dimension,
+								  RenderStats *stats) const {
+	return render_tiles(vp, dimension, stats, nullptr);
+}
+
+Framebuffer ImageRenderer::render(const Viewport &vp, Rect dimension,
+								  CostMap &cost, RenderStats *stats) const {
+	gsl_Expects(cost.dimension() == dimension);
+	cost = CostMap{dimension, cost.metric()};
+	return render_tiles(vp, dimension, stats, &cost);
+}
+
+Framebuffer ImageRenderer::render_tiles(const Viewport &vp, Rect dimension,
+										RenderStats *stats, CostMap *cost,
+										PngStream *png) const {
+	gsl_Expects(png == nullptr || png->band_height() == tile_size_);
 	spdlog::stopwatch sw;
-	auto out = fmt::output_file(filename);
-	out.print("P3\n{} {}\n255\n", dimension.width, dimension.height);
-
-	// i=872 412
-	for (size_t j = 0; j < dimension.height; ++j) {
-		for (size_t i = 0; i < dimension.width; ++i) {
-			const Ray r = get_ray(vp, i, j);
-			print(out, trace_ray(r), screen_gamma);
+	Framebuffer framebuffer{dimension};
+	const auto tiles = split_into_tiles(dimension, tile_size_);
+	std::vector<RenderStats> tile_stats(tiles.size());
+	// The tiles of every row of tiles still being traced
+	const size_t tiles_per_row
+		= (dimension.width + tile_size_ - 1) / tile_size_;
+	std::vector<std::atomic<size_t>> untraced(
+		png != nullptr ? png->band_count() : 0);
+	for (auto &count : untraced) count = tiles_per_row;
+
+	ThreadPool pool{std::min(thread_count_, tiles.size())};
+	pool.parallel_for(tiles.size(), [&](size_t t) {
+		const auto &[x, y, width, height] = tiles[t];
+		// The pixels of the tile still sampled, by their index in the tile
+		std::vector<uint32_t> active(width * height);
+		std::iota(active.begin(), active.end(), 0U);
+		// The sums of the squared deviations from the mean, per channel
+		std::vector<ScaledColor> m2(active.size(), ScaledColor::Zero());
+		std::vector<uint32_t> pixels;
+		std::vector<Ray> rays;
+		std::vector<ScaledColor> colors;
+		std::vector<float> costs;
+
+		for (uint32_t sample = 0;
+			 sample < samples_per_pixel_ && !active.empty();
+			 ++sample) {
+			pixels.clear();
+			rays.clear();
+			for (const uint32_t k : active) {
+				const size_t i = x + k % width;
+				const size_t j = y + k / width;
+				pixels.push_back(
+					static_cast<uint32_t>(j * dimension.width + i));
+				const Eigen::Vector2f offset
+					= subpixel_offset(pixels.back(), sample);
+				rays.push_back(get_ray(vp, i, j, offset.x(), offset.y()));
+			}
+
+			colors.resize(rays.size());
+			costs.resize(cost != nullptr ? rays.size() : 0);
+			if (cost != nullptr && cost->metric() == CostMetric::TIME) {
+				for (size_t k = 0; k < rays.size(); ++k) {
+					const auto start = std::chrono::steady_clock::now();
+					trace_rays(std::span{rays}.subspan(k, 1),
+							   std::span{colors}.subspan(k, 1),
+							   &tile_stats[t],
+							   {},
+							   std::span{pixels}.subspan(k, 1),
+							   sample);
+					const std::chrono::duration<float, std::nano> elapsed
+						= std::chrono::steady_clock::now() - start;
+					costs[k] = elapsed.count();
+				}
+			} else {
+				trace_rays(rays, colors, &tile_stats[t], costs, pixels, sample);
+			}
+
+			// Welford's running mean, kept in the framebuffer, is exact for
+			// a single sample
+			const auto n = static_cast<float>(sample + 1);
+			for (size_t a = 0; a < active.size(); ++a) {
+				const uint32_t k = active[a];
+				const size_t i = x + k % width;
+				const size_t j = y + k / width;
+				ScaledColor &mean       = framebuffer.at(i, j);
+				const ScaledColor delta = colors[a] - mean;
+				mean += delta / n;
+				m2[k] += delta.cwiseProduct(colors[a] - mean);
+				if (cost != nullptr) cost->at(i, j) += costs[a];
+			}
+
+			if (max_error_ == 0.f || sample + 1 < min_samples_) continue;
+			// The standard error of the mean is sqrt(m2 / (n (n - 1)))
+			const float max_variance = max_error_ * max_error_ * n * (n - 1);
+			std::erase_if(active, [&](uint32_t k) {
+				return m2[k].maxCoeff() <= max_variance;
+			});
 		}
+
+		const size_t band = t / tiles_per_row;
+		if (png != nullptr && --untraced[band] == 0)
+			png->write_band(framebuffer, band);
+	});
+
+	if (stats != nullptr) {
+		*stats = {};
+		for (const auto &tile : tile_stats) *stats += tile;
+		stats->seconds           = sw.elapsed().count();
+		stats->samples_per_pixel = static_cast<double>(stats->primary_rays)
+								 / static_cast<double>(dimension.area());
 	}
-	spdlog::info("Writing to {} elapsed {} seconds", filename.c_str(), sw);
+	return framebuffer;
+}
+
+Framebuffer ImageRenderer::render_for(const Viewport &vp, Rect dimension,
+									  std::chrono::nanoseconds budget,
+									  RenderStats *stats) const {
+	SampleBuffer buffer{dimension};
+	return refine_for(vp, buffer, budget, stats);
+}
+
+Framebuffer ImageRenderer::render_for(
+	const Viewport &vp, Rect dimension, std::chrono::nanoseconds budget,
+	const std::filesystem::path &checkpoint, RenderStats *stats) const {
+	SampleBuffer buffer{checkpoint,
+						dimension,
+						seed_,
+						static_cast<uint32_t>(tile_size_)};
+	return refine_for(vp, buffer, budget, stats);
+}
+
+Framebuffer ImageRenderer::resume(const Viewport &vp,
+								  const std::filesystem::path &checkpoint,
+								  std::chrono::nanoseconds budget,
+								  RenderStats *stats) const {
+	SampleBuffer buffer = SampleBuffer::resume(checkpoint);
+	// The passes still to come go on with the seed and tiles of the render
+	if (buffer.seed() != seed_)
+		throw std::runtime_error(checkpoint.string()
+								 + " was rendered with another seed");
+	if (buffer.tile_size() != tile_size_)
+		throw std::runtime_error(checkpoint.string()
+								 + " was rendered with another tile size");
+	spdlog::info("Resuming {} after {} passes",
+				 checkpoint.string(),
+				 buffer.passes());
+	return refine_for(vp, buffer, budget, stats);
+}
+
+Framebuffer ImageRenderer::refine_for(const Viewport &vp, SampleBuffer &buffer,
+									  std::chrono::nanoseconds budget,
+									  RenderStats *stats) const {
+	spdlog::stopwatch sw;
+	const auto deadline = std::chrono::steady_clock::now() + budget;
+	RenderStats counters;
+	refine(vp, buffer, deadline, &counters);
+
+	counters.seconds = sw.elapsed().count();
+	spdlog::info("Rendered {} passes, {:.2f} samples per pixel in {}",
+				 buffer.passes(),
+				 counters.samples_per_pixel,
+				 sw);
+	if (stats != nullptr) *stats = counters;
+	return buffer.image();
+}
+
+void ImageRenderer::refine(const Viewport &vp, SampleBuffer &buffer,
+						   std::chrono::steady_clock::time_point deadline,
+						   RenderStats *stats) const {
+	const Rect dimension = buffer.dimension();
+	const auto tiles     = split_into_tiles(dimension, tile_size_);
+	std::vector<RenderStats> tile_stats(tiles.size());
+	ThreadPool pool{std::min(thread_count_, tiles.size())};
+	const uint32_t first_pass = buffer.passes();
+
+	for (bool done = false; !done;) {
+		const uint32_t pass = buffer.passes();
+		const bool coarse   = pass < COARSE_PASSES;
+		// The pixels traced in a coarse pass lie on a grid of this step
+		const uint32_t step = coarse ? COARSEST_BLOCK >> pass : 1;
+		// A pixel is traced once it has this many samples, so that a pass
+		// cut short traces only the pixels left when it is resumed
+		const uint32_t due = coarse ? 0 : pass - COARSE_PASSES;
+		const auto is_due  = [&](size_t i, size_t j) {
+			if (i % step != 0 || j % step != 0) return false;
+			// Unless previewed by a coarser pass already
+			if (coarse)
+				return pass == 0 || i % (2 * step) != 0 || j % (2 * step) != 0;
+			if (buffer.count(i, j) != due) return false;
+			return max_error_ == 0.f || due < min_samples_
+				|| buffer.standard_error(i, j) > max_error_;
+		};
+
+		std::atomic<bool> cut_short = false;
+		std::atomic<size_t> traced  = 0;
+		pool.parallel_for(tiles.size(), [&](size_t t) {
+			if (pass > first_pass
+				&& std::chrono::steady_clock::now() >= deadline) {
+				cut_short = true;
+				return;
+			}
+
+			const auto &[x, y, width, height] = tiles[t];
+			std::vector<uint32_t> pixels;
+			std::vector<Ray> rays;
+			for (size_t j = y; j < y + height; ++j)
+				for (size_t i = x; i < x + width; ++i) {
+					if (!is_due(i, j)) continue;
+					pixels.push_back(
+						static_cast<uint32_t>(j * dimension.width + i));
+					const Eigen::Vector2f offset
+						= coarse ? Eigen::Vector2f::Zero()
+								 : progressive_offset(pixels.back(), due);
+					rays.push_back(get_ray(vp, i, j, offset.x(), offset.y()));
+				}
+
+			std::vector<ScaledColor> colors(rays.size());
+			trace_rays(rays, colors, &tile_stats[t], {}, pixels, due);
+			for (size_t k = 0; k < pixels.size(); ++k) {
+				const size_t i = pixels[k] % dimension.width;
+				const size_t j = pixels[k] / dimension.width;
+				// The center of a pixel previews it, no sample goes there
+				if (coarse) buffer.mean(i, j) = colors[k];
+				else buffer.add_sample(i, j, colors[k]);
+			}
+			traced += pixels.size();
+		});
+
+		if (coarse) {
+			// Fills the pixels off the grid from the closest traced one above
+			// and to the left
+			for (size_t j = 0; j < dimension.height; ++j)
+				for (size_t i = 0; i < dimension.width; ++i)
+					if (i % step != 0 || j % step != 0)
+						buffer.mean(i, j)
+							= buffer.mean(i - i % step, j - j % step);
+		}
+
+		if (cut_short) break;
+		buffer.set_passes(pass + 1);
+		// The workers are idle until the next pass either way
+		buffer.sync();
+		// Every pixel has converged, or the time is up
+		done = (pass >= COARSE_PASSES && traced == 0)
+			|| std::chrono::steady_clock::now() >= deadline;
+	}
+
+	if (stats != nullptr) {
+		for (const auto &tile : tile_stats) *stats += tile;
+		stats->samples_per_pixel = buffer.samples_per_pixel();
+	}
+}
+
+void ImageRenderer::save_image(fmt::cstring_view filename, const Viewport &vp,
+							   Rect dimension, float screen_gamma) {
+	spdlog::stopwatch sw;
+	RenderStats stats;
+	write_ppm(filename, render(vp, dimension, &stats), screen_gamma);
+	spdlog::info("Writing to {} elapsed {} seconds, {:.2f} Mrays/s",
+				 filename.c_str(),
+				 sw,
+				 stats.mrays_per_second());
 }
 
 ScaledColor
 ImageRenderer::local_illumination(const Intersection &intersection) const {
 	ScaledColor sum = intersection.material->attenuation();
 
-	for (const auto &light : light_source_list_)
-		if (Ray r = standard_form_of(intersection.position, light.position);
-			hit_any_obstacle(r)) {
+	for (const auto &light : light_source_list_) {
+		const Vector3f to_light = light.position - intersection.position;
+		const float distance    = to_light.norm();
+		if (const Ray r{intersection.position, to_light / distance};
+			!hit_any_obstacle(r, distance)) {
 			// TODO: Where is diffuse coeff?
 			sum += intersection.normal.dot(r.direction) * light.color;
 		}
+	}
 	return sum;
 }
 
-bool ImageRenderer::hit_any_obstacle(const Ray &r) const {
-	return world_.none_match([&r](const auto &obstacle) {
-		const auto closest = obstacle->hit(r);
-
-		if (!std::isinf(closest)) return false;
-		return closest > r.direction.squaredNorm();
-	});
+bool ImageRenderer::hit_any_obstacle(const Ray &r, float t_max) const {
+	return world_.is_occluded(r, t_max);
 }
 
 float ImageRenderer::target_refractive_index(Vector3fConstRef point) const {
@@ -75,58 +494,236 @@ float ImageRenderer::target_refractive_index(Vector3fConstRef point) const {
 	return obstacle.value()->get_optics().get_refractive_index();
 }
 
-ScaledColor ImageRenderer::trace_ray(const Ray &ray,
-									 uint8_t bounce_count) const {
-	if (exceeds_bounce_limit(bounce_count)) return ScaledColor::Zero();
-
-	auto intersection = world_.find_closest_intersection(ray);
-	if (!intersection.has_value()) return ScaledColor::Ones();
+ImageRenderer::Scattering
+ImageRenderer::scatter(const Ray &ray, Intersection &intersection) const {
 	const Vector3f incidence = ray.direction.normalized();
 
-	float eta = ambient_ior_ / intersection->material->get_refractive_index();
+	float eta = ambient_ior_ / intersection.material->get_refractive_index();
 
 	// Ray hits the object's inner face
-	if (intersection->normal.dot(incidence) > 0) {
-		intersection->normal = -intersection->normal;
-		eta                  = 1 / eta;
+	if (intersection.normal.dot(incidence) > 0) {
+		intersection.normal = -intersection.normal;
+		eta                 = 1 / eta;
 	}
 
-	auto reflection_coeff = reflectance(incidence, intersection->normal, eta);
+	auto reflection_coeff = reflectance(incidence, intersection.normal, eta);
 
-	const ScaledColor local = local_illumination(*intersection);
 	// FIXME: When negate normal, this lower down intersection inside sphere
-	const ScaledColor reflected = trace_ray(
-		Ray{intersection->position, reflect(incidence, intersection->normal)},
-		bounce_count + 1);
+	return {
+		Ray{intersection.position, reflect(incidence, intersection.normal)},
+		Ray{intersection.position,
+			refract(incidence, intersection.normal, eta)},
+		intersection.material->light_contribution(reflection_coeff)};
+}
+
+template <class Draw>
+float ImageRenderer::branch_scale(float throughput, Draw &&draw) const {
+	if (throughput <= 0.f) return 0.f;
+
+	switch (culling_) {
+	case BranchCulling::NONE: return 1.f;
+	case BranchCulling::THRESHOLD:
+		return throughput < optical::MIN_INTENSITY ? 0.f : 1.f;
+	case BranchCulling::RUSSIAN_ROULETTE:
+		if (throughput >= ROULETTE_THRESHOLD) return 1.f;
+		if (draw() * ROULETTE_THRESHOLD >= throughput) return 0.f;
+		return ROULETTE_THRESHOLD / throughput;
+	}
+	return 1.f;
+}
+
+float ImageRenderer::roulette_draw(uint32_t pixel, uint32_t sample,
+								   uint32_t path) const {
+	// The block of the path among the numbers of the sample of the pixel
+	const uint64_t seed = seed_ ^ ROULETTE_STREAM;
+	const Rng::Key key{static_cast<uint32_t>(seed),
+					   static_cast<uint32_t>(seed >> 32)};
+	return Rng::to_unit_float(Rng::philox({path, 0, pixel, sample}, key)[0]);
+}
+
+ScaledColor ImageRenderer::trace_ray(const Ray &ray, uint32_t pixel,
+									 uint32_t sample) const {
+	return trace_path(ray, pixel, sample, 1, 0, 1.f);
+}
+
+ScaledColor ImageRenderer::trace_path(const Ray &ray, uint32_t pixel,
+									  uint32_t sample, uint32_t path,
+									  uint8_t bounce_count,
+									  float throughput) const {
+	if (exceeds_bounce_limit(bounce_count)) return ScaledColor::Zero();
+
+	auto intersection = world_.find_closest_intersection(ray);
+	if (!intersection.has_value()) return ScaledColor::Ones();
+
+	auto [reflected_ray, refracted_ray, weights] = scatter(ray, *intersection);
+
+	const auto trace_branch = [&](const Ray &branch, float &weight,
+								  uint32_t branch_path) {
+		weight *= branch_scale(throughput * weight, [&] {
+			return roulette_draw(pixel, sample, branch_path);
+		});
+		if (weight == 0.f) return ScaledColor::Zero().eval();
+		return trace_path(branch,
+						  pixel,
+						  sample,
+						  branch_path,
+						  bounce_count + 1,
+						  throughput * weight);
+	};
+
+	const ScaledColor local     = weights[0] == 0.f
+									  ? ScaledColor::Zero()
+									  : local_illumination(*intersection);
+	const ScaledColor reflected
+		= trace_branch(reflected_ray, weights[1], 2 * path);
 	const ScaledColor refracted
-		= trace_ray(Ray{intersection->position,
-						refract(incidence, intersection->normal, eta)},
-					bounce_count + 1);
+		= trace_branch(refracted_ray, weights[2], 2 * path + 1);
 	Eigen::Matrix3f color;
 	color << local, reflected, refracted;
-	return color * intersection->material->light_contribution(reflection_coeff);
+	return color * weights;
+}
+
+void ImageRenderer::trace_rays(std::span<const Ray> rays,
+							   std::span<ScaledColor> colors,
+							   RenderStats *stats, std::span<float> tests,
+							   std::span<const uint32_t> pixels,
+							   uint32_t sample) const {
+	gsl_Expects(rays.size() == colors.size());
+	gsl_Expects(tests.empty() || tests.size() == rays.size());
+	gsl_Expects(pixels.empty() || pixels.size() == rays.size());
+	std::ranges::fill(colors, ScaledColor::Zero());
+	std::ranges::fill(tests, 0.f);
+	RenderStats counters;
+	TraversalStats traversal;
+	counters.primary_rays = rays.size();
+
+	// Charges the tests of a query to the pixel of its ray
+	const auto count = [&](const TraversalStats &query, uint32_t pixel) {
+		traversal += query;
+		if (!tests.empty())
+			tests[pixel] += static_cast<float>(query.node_visits
+											   + query.primitive_tests);
+	};
+
+	// Every branch plays the roulette with a number of its own, whichever
+	// wavefront it is traced in
+	const auto roulette = [&](uint32_t ray, uint32_t path) {
+		return roulette_draw(pixels.empty() ? ray : pixels[ray], sample, path);
+	};
+
+	// The rays waiting at every bounce. The deepest ones go first, at most
+	// MAX_WAVEFRONT at a time, so a queue never holds more than twice as many
+	// as that however the branches multiply, the primary rays aside.
+	std::vector<RayQueue> waiting(bounce_limit_);
+	if (!waiting.empty())
+		for (size_t i = 0; i < rays.size(); ++i)
+			waiting[0].push(rays[i], 1.f, static_cast<uint32_t>(i));
+	RayQueue shadows;
+	std::vector<std::optional<HitRecord>> hits;
+
+	for (uint8_t bounce_count = 0; bounce_count < waiting.size();) {
+		RayQueue &current = waiting[bounce_count];
+		if (current.empty()) {
+			if (bounce_count == 0) break;
+			--bounce_count;
+			continue;
+		}
+
+		const size_t end   = current.size();
+		const size_t begin = end - std::min(end, MAX_WAVEFRONT);
+		counters.depth_histogram[bounce_count] += end - begin;
+		hits.resize(end - begin);
+		for (size_t i = begin; i < end; ++i) {
+			TraversalStats query;
+			hits[i - begin] = world_.find_closest_hit(current.ray(i), &query);
+			count(query, current.pixel(i));
+		}
+
+		const bool is_last = exceeds_bounce_limit(bounce_count + 1);
+		RayQueue *next     = is_last ? nullptr : &waiting[bounce_count + 1];
+		shadows.clear();
+		for (size_t i = begin; i < end; ++i) {
+			const std::optional<HitRecord> &hit = hits[i - begin];
+			const float throughput              = current.throughput(i);
+			ScaledColor &color                  = colors[current.pixel(i)];
+			if (!hit.has_value()) {
+				color += throughput * ScaledColor::Ones();
+				continue;
+			}
+
+			const Ray ray = current.ray(i);
+			auto intersection = hit->to_intersection(ray);
+			const auto [reflected, refracted, weights]
+				= scatter(ray, intersection);
+
+			// The terms of local_illumination(), the lit ones once their
+			// shadow rays get through
+			const float local = throughput * weights[0];
+			color += local * intersection.material->attenuation();
+			for (const auto &light : light_source_list_) {
+				// No shadow ray for a term that adds nothing
+				if (local == 0.f) break;
+
+				const Vector3f to_light
+					= light.position - intersection.position;
+				const float distance = to_light.norm();
+				const Ray r{intersection.position, to_light / distance};
+				shadows.push_shadow(
+					r,
+					distance,
+					local * intersection.normal.dot(r.direction) * light.color,
+					current.pixel(i));
+			}
+
+			if (is_last) continue;
+			const auto push_branch = [&](const Ray &branch, float weight,
+										 uint32_t path) {
+				const float branch_throughput = throughput * weight;
+				const float scale = branch_scale(branch_throughput, [&] {
+					return roulette(current.pixel(i), path);
+				});
+				if (scale > 0.f) {
+					next->push(branch,
+							   branch_throughput * scale,
+							   current.pixel(i),
+							   path);
+					++counters.secondary_rays;
+				} else {
+					++counters.early_terminations;
+				}
+			};
+			push_branch(reflected, weights[1], 2 * current.path(i));
+			push_branch(refracted, weights[2], 2 * current.path(i) + 1);
+		}
+		current.truncate(begin);
+
+		counters.shadow_rays += shadows.size();
+		for (size_t i = 0; i < shadows.size(); ++i) {
+			TraversalStats query;
+			if (!world_.is_occluded(shadows.ray(i), shadows.t_max(i), &query))
+				colors[shadows.pixel(i)] += shadows.color(i);
+			count(query, shadows.pixel(i));
+		}
+
+		if (next != nullptr && !next->empty()) ++bounce_count;
+	}
+
+	if (stats != nullptr) {
+		counters.add(traversal);
+		*stats += counters;
+	}
 }
 
 void ImageRenderer::export_png(const std::string &filename, const Viewport &vp,
 							   Rect dimension, float screen_gamma) const {
 	spdlog::stopwatch sw;
-	// I prefer std::array here, but lodepng API requires std::vector
-	std::vector<uint8_t> rgba_buffer(dimension.area());
-
-	for (size_t j = 0; j < dimension.height; ++j)
-		for (size_t i = 0; i < dimension.width; ++i) {
-			const Ray r      = get_ray(vp, i, j);
-			const auto final = to_rgb(trace_ray(r), screen_gamma);
-			for (auto component : final) rgba_buffer.push_back(component);
-		}
-	const auto error = lodepng::encode(filename,
-									   rgba_buffer,
-									   dimension.width,
-									   dimension.height,
-									   LCT_RGB);
-	if (error)
-		spdlog::error("PNG encoder error: {}", lodepng_error_text(error));
-	spdlog::info("Writing to {} elapsed {} seconds", filename, sw);
+	RenderStats stats;
+	PngStream png{filename, dimension, tile_size_, screen_gamma};
+	std::ignore = render_tiles(vp, dimension, &stats, nullptr, &png);
+	spdlog::info("Writing to {} elapsed {} seconds, {:.2f} Mrays/s",
+				 filename,
+				 sw,
+				 stats.mrays_per_second());
 }
 
 } // namespace raytracing
@@ -3,32 +3,110 @@
 
 // IWYU pragma: no_include "vector3f.hpp"
 #include "constants/indexes_of_refraction.hpp"
+#include "cost_map.hpp"
+#include "framebuffer.hpp"
+#include "image_encoder.hpp"
 #include "intersection.hpp"
 #include "light_source.hpp"
 #include "ray.hpp"
 #include "rect.hpp"
+#include "render_stats.hpp"
+#include "sample_buffer.hpp"
 #include "solid_object_list.hpp"
 #include "vector3f.hpp"
 #include "viewport.hpp"
 
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
 #include <lodepng.h>
 #include <memory>
+#include <span>
 #include <spdlog/spdlog.h>
 #include <spdlog/stopwatch.h>
+#include <thread>
+#include <utility>
+#include <vector>
 
 namespace raytracing {
+/**
+ * \brief How the reflected and refracted branches too weak to make a visible
+ * difference are dropped, from the throughput they would carry.
+ */
+enum class BranchCulling {
+	NONE,      // Only the branches of zero weight, which add nothing anyway
+	THRESHOLD, // Also those under optical::MIN_INTENSITY, slightly biased
+	// Those under optical::MIN_RGB_COMPONENT survive at random, in proportion
+	// to their throughput, and the survivors are scaled up to stay unbiased
+	RUSSIAN_ROULETTE,
+};
+
+/**
+ * \brief How the samples of a pixel are spread and weighted, see
+ * ImageRenderer::set_samples_per_pixel().
+ */
+enum class PixelFilter {
+	BOX,  // Uniform over the pixel, every sample weighs the same
+	TENT, // Over the pixel and half its neighbours, denser near the center
+};
+
 /**
  * \brief The Scene object renders a collection of SolidObjects and
  * LightSources that illuminate them.
  */
 class ImageRenderer {
 public:
+	// How many rays of a bounce trace_rays() takes through a stage together
+	static constexpr size_t MAX_WAVEFRONT = 4096;
+
 	explicit ImageRenderer(Vector3fConstRef orig,
 						   float ambient_ior    = ior::VACUUM,
 						   uint8_t bounce_limit = 5);
 
 	void add(std::unique_ptr<SolidObject> &&solid);
 
+	/**
+	 * \brief Constructs a \a Solid from \a args directly in the contiguous
+	 * array of its type, sparing the allocation of add().
+	 */
+	template <class Solid, class... Args> void emplace(Args &&...args) {
+		world_.emplace<Solid>(std::forward<Args>(args)...);
+	}
+
+	/**
+	 * \brief Builds a bounding volume hierarchy over the objects added so far,
+	 * so that the cost of tracing a ray grows logarithmically with the number
+	 * of objects instead of linearly.
+	 *
+	 * It is built on set_thread_count() threads, \a builder trades the time
+	 * to build it for the time to trace rays through it, \a layout picks the
+	 * nodes the rays go through. The time it took and the SAH cost of the
+	 * tree are logged.
+	 *
+	 * \note Adding another object drops it, call this again afterwards.
+	 */
+	void build_bvh(BvhBuilder builder = BvhBuilder::BINNED_SAH,
+				   BvhLayout layout   = BvhLayout::BINARY);
+
+	/**
+	 * \brief Calls \a transform with the object added \a id -th, e.g. to
+	 * rotate() or translate() it before the next frame of an animation, see
+	 * SolidObjectList::transform().
+	 */
+	template <class Transform>
+	void transform(size_t id, Transform &&transform) {
+		world_.transform(id, std::forward<Transform>(transform));
+	}
+
+	/**
+	 * \brief Fits the bounding volume hierarchy again around the objects
+	 * transformed since it was built, on set_thread_count() threads, unless
+	 * it degraded by more than \a max_degradation and is rebuilt.
+	 *
+	 * \return true if it was rebuilt.
+	 */
+	bool refit_bvh(float max_degradation = Bvh::DEFAULT_MAX_DEGRADATION);
+
 	void set_light_sources(LightSourceList &&light_source_list);
 
 	// By default, regions of space that are not explicitly occupied by some
@@ -37,6 +115,162 @@ public:
 	// [REFRACTION_MINIMUM..REFRACTION_MAXIMUM].
 	void set_ambient_refraction(float index);
 
+	/**
+	 * \brief Sets how many threads trace the tiles of an image, 1 renders on
+	 * the calling thread only.
+	 */
+	void set_thread_count(size_t thread_count);
+
+	/**
+	 * \brief Sets how trace_ray() and trace_rays() prune the tree of rays,
+	 * BranchCulling::THRESHOLD by default.
+	 */
+	void set_branch_culling(BranchCulling culling);
+
+	/**
+	 * \brief Sets the seed of the random numbers drawn while rendering.
+	 *
+	 * Every random number is a function of the seed, the pixel and the
+	 * sample it is drawn for, so an image is reproducible whatever the
+	 * number of threads and the tile size.
+	 */
+	void set_seed(uint64_t seed);
+
+	/**
+	 * \brief Sets how many rays are traced through every pixel and averaged,
+	 * 1 by default.
+	 *
+	 * The samples are correlated multi-jittered: every sample is jittered
+	 * within its own row of the pixel and its own column, and the samples
+	 * fill a grid of about the square root of their number cells each way,
+	 * whatever their number, prime or not. This leaves less noise on the
+	 * edges than purely random positions. A single sample goes through the
+	 * pixel center.
+	 */
+	void set_samples_per_pixel(uint32_t samples_per_pixel);
+
+	/**
+	 * \brief Sets the filter the samples of a pixel are drawn from,
+	 * PixelFilter::BOX by default.
+	 *
+	 * The jittered offsets are warped to the density of the filter, so every
+	 * sample keeps the same weight and adds to its own pixel only.
+	 */
+	void set_pixel_filter(PixelFilter filter);
+
+	/**
+	 * \brief Stops sampling a pixel once the standard error of its mean
+	 * color falls to \a max_error, with set_samples_per_pixel() as the most
+	 * samples any pixel gets.
+	 *
+	 * Every pixel keeps the running variance of its samples, per channel,
+	 * and takes at least \a min_samples of them so that a few equal samples
+	 * by chance cannot stop it. Flat regions, like the background, converge
+	 * after the minimum, while edges and glossy reflections get the most.
+	 *
+	 * \param max_error 0, the default, samples every pixel fully.
+	 */
+	void set_adaptive_sampling(float max_error, uint32_t min_samples = 4);
+
+	/**
+	 * \brief Sets the side length in pixels of the square tiles an image is
+	 * split into.
+	 *
+	 * Smaller tiles balance the load better, larger ones have less scheduling
+	 * overhead.
+	 */
+	void set_tile_size(size_t tile_size);
+
+	/**
+	 * \brief Traces the ray through every pixel of the image, tile by tile,
+	 * on a pool of set_thread_count() threads, every tile as one wavefront of
+	 * trace_rays().
+	 *
+	 * Every pixel is traced independently, so the result does not depend on
+	 * the number of threads nor the tile size. The samples of a pixel are
+	 * traced one after the other, each wavefront holding one sample of every
+	 * pixel of the tile, and averaged straight into the framebuffer.
+	 *
+	 * \param dimension The resolution of the output image.
+	 * \param stats If not null, receives the counters of the render, see
+	 * write_json() to keep them.
+	 * \return The linear colors of the image, ready to be written by any of
+	 * the encoders in image_encoder.hpp.
+	 */
+	[[nodiscard]] Framebuffer render(const Viewport &vp, Rect dimension,
+									 RenderStats *stats = nullptr) const;
+
+	/**
+	 * \brief Renders the image like render(), also recording in \a cost what
+	 * every pixel cost to trace, for to_false_color().
+	 *
+	 * With CostMetric::TIME, every pixel is traced as its own wavefront to be
+	 * timed, which is slower than tracing whole tiles.
+	 */
+	[[nodiscard]] Framebuffer render(const Viewport &vp, Rect dimension,
+									 CostMap &cost,
+									 RenderStats *stats = nullptr) const;
+
+	/**
+	 * \brief Renders the image within a wall-clock \a budget rather than
+	 * with a fixed number of samples, see refine().
+	 *
+	 * \param stats If not null, receives the counters of the render, with the
+	 * samples per pixel achieved.
+	 */
+	[[nodiscard]] Framebuffer render_for(const Viewport &vp, Rect dimension,
+										 std::chrono::nanoseconds budget,
+										 RenderStats *stats = nullptr) const;
+
+	/**
+	 * \brief Renders the image like render_for(), its samples kept in the
+	 * file \a checkpoint all along, see SampleBuffer.
+	 *
+	 * The checkpoint is written back by the system as the passes go, the
+	 * workers never wait for it.
+	 */
+	[[nodiscard]] Framebuffer
+	render_for(const Viewport &vp, Rect dimension,
+			   std::chrono::nanoseconds budget,
+			   const std::filesystem::path &checkpoint,
+			   RenderStats *stats = nullptr) const;
+
+	/**
+	 * \brief Goes on refining the image kept in \a checkpoint for another \a
+	 * budget, after a crash or once the budget of render_for() ran out.
+	 *
+	 * \throws std::runtime_error if \a checkpoint is no sample buffer or was
+	 * rendered with another seed or tile size.
+	 */
+	[[nodiscard]] Framebuffer resume(const Viewport &vp,
+									 const std::filesystem::path &checkpoint,
+									 std::chrono::nanoseconds budget,
+									 RenderStats *stats = nullptr) const;
+
+	/**
+	 * \brief Adds samples to \a buffer, in passes over the whole image, until
+	 * \a deadline, so that it always holds a complete image.
+	 *
+	 * The first passes are coarse: one ray every 8 pixels each way, whose
+	 * color fills its whole block, then every 4, 2 and finally every pixel.
+	 * Their rays go through the pixel centers and only preview the image,
+	 * the first sample of a pixel replaces its preview. Every later pass adds
+	 * one sample to every pixel, jittered along a low discrepancy sequence
+	 * and warped as set_pixel_filter() tells, skipping those converged as
+	 * set_adaptive_sampling() tells, so that the mean converges to the same
+	 * image as render().
+	 *
+	 * No tile starts after the deadline, so it is overshot by at most the
+	 * time of one tile per thread, except that the pass the call starts on
+	 * always completes, so that every call makes progress. A pass cut short
+	 * is completed by the next call.
+	 *
+	 * \param stats If not null, the counters of the passes are added to it.
+	 */
+	void refine(const Viewport &vp, SampleBuffer &buffer,
+				std::chrono::steady_clock::time_point deadline,
+				RenderStats *stats = nullptr) const;
+
 	/**
 	 * \brief Generate an image of the scene and write it to the .ppm format
 	 *
@@ -46,13 +280,23 @@ public:
 	 * \param dimension The resolution of the output image.
 	 * \param filename A relative directory to write the image in ppm format.
 	 * \param screen_gamma Defaults to 1 incidcates no gamma correction
+	 *
+	 * \note Prefer render() followed by write_ppm() to write the same image in
+	 * several formats.
 	 */
 	void save_image(fmt::cstring_view filename, const Viewport &vp,
 					Rect dimension, float screen_gamma = 1.f);
 
 	/**
-	 * \brief Downsample the image buffer to an unsigned char array of RGBA
-	 * values that LodePNG understands.
+	 * \brief Renders the image like render() and writes it to the .png format
+	 * meanwhile, see PngStream.
+	 *
+	 * Every row of tiles is compressed by the thread finishing its last tile,
+	 * while the others go on tracing, so that encoding mostly hides behind
+	 * rendering.
+	 *
+	 * \throws std::runtime_error or std::system_error if the file cannot be
+	 * written, once every tile being traced is done.
 	 */
 	void export_png(const std::string &filename, const Viewport &vp,
 					Rect dimension, float screen_gamma = 1.f) const;
@@ -63,9 +307,11 @@ public:
 	 *
 	 * \param i pixel row-th
 	 * \param j pixel height-th
+	 * \param du, dv The offset from the pixel center in pixels, along the
+	 * delta_u and delta_v of \a viewport.
 	 */
-	[[nodiscard]] Ray get_ray(const Viewport &viewport, size_t i,
-							  size_t j) const;
+	[[nodiscard]] Ray get_ray(const Viewport &viewport, size_t i, size_t j,
+							  float du = 0.f, float dv = 0.f) const;
 
 	/**
 	 * \brief Computes the local illumination color at a surface point based on
@@ -93,14 +339,13 @@ public:
 	local_illumination(const Intersection &intersection) const;
 
 	/**
-	 * \brief Returns true if the ray \a can hit no obstacle, False otherwise
+	 * \brief Returns true if any obstacle lies on \a r before the root \a
+	 * t_max, i.e. between the intersection point and the light source.
 	 *
-	 * The closest intersection found is a blocker if it is closer to
-	 * intersection point than the light source. Clearly, when the closest
-	 * intersection is farther away than point2, conclude that there is no
-	 * blocker
+	 * Any blocker is enough to keep the light out, so the search stops at the
+	 * first one found rather than looking for the closest.
 	 */
-	[[nodiscard]] bool hit_any_obstacle(const Ray &r) const;
+	[[nodiscard]] bool hit_any_obstacle(const Ray &r, float t_max) const;
 
 	/**
 	 */
@@ -115,11 +360,114 @@ public:
 	 * the equation for computing the color in a scene involving both reflection
 	 * and refraction to assign the color of the pixel corresponding to that
 	 * pixel.
+	 *
+	 * \param pixel, sample Key the Russian roulette of the branches as in
+	 * trace_rays(), so that both cull the same ones.
 	 */
-	[[nodiscard]]
-	ScaledColor trace_ray(const Ray &ray, uint8_t bounce_count = 0) const;
+	[[nodiscard]] ScaledColor trace_ray(const Ray &ray, uint32_t pixel = 0,
+										uint32_t sample = 0) const;
+
+	/**
+	 * \brief Determines the colors of \a rays, the same as trace_ray() up to
+	 * rounding, breadth-first instead of depth-first.
+	 *
+	 * The rays of every bounce wait in a RayQueue and go through each stage
+	 * together, MAX_WAVEFRONT at most: the closest hits of all of them, then
+	 * their shading, then the shadow rays it spawns. The deepest bounce goes
+	 * first, so the queues stay bounded even when no branch is culled. Each
+	 * ray carries its throughput, the product of the weights along its path,
+	 * and adds its share of color straight into its pixel, so no stage waits
+	 * for the colors of the next bounce. The weakest branches are culled as
+	 * set_branch_culling() tells.
+	 *
+	 * \param colors Receives the color of every ray, the same size as \a
+	 * rays.
+	 * \param stats If not null, the counters of the rays traced are added to
+	 * it, all but the elapsed time.
+	 * \param tests If not empty, receives the number of intersection tests,
+	 * with boxes and objects, spent on every ray and the rays it spawned.
+	 * \param pixels If not empty, the pixel of the image of every ray, which
+	 * with \a sample keys the Russian roulette of its branches. Otherwise,
+	 * the index of every ray is its pixel.
+	 */
+	void trace_rays(std::span<const Ray> rays, std::span<ScaledColor> colors,
+					RenderStats *stats               = nullptr,
+					std::span<float> tests           = {},
+					std::span<const uint32_t> pixels = {},
+					uint32_t sample                  = 0) const;
 
 private:
+	// The cost and the stream are optional, render() needs neither. The
+	// stream takes every row of tiles as a band once it is traced.
+	[[nodiscard]] Framebuffer render_tiles(const Viewport &vp, Rect dimension,
+										   RenderStats *stats, CostMap *cost,
+										   PngStream *png = nullptr) const;
+
+	/**
+	 * \brief What a ray turns into where it hits a surface.
+	 */
+	struct Scattering {
+		Ray reflected, refracted;
+		// Of the local, reflected and refracted colors
+		Vector3f weights;
+	};
+
+	/**
+	 * \brief Returns the rays reflected and refracted at \a intersection,
+	 * first turning its normal to face \a ray.
+	 */
+	[[nodiscard]] Scattering scatter(const Ray &ray,
+									 Intersection &intersection) const;
+
+	/**
+	 * \brief Returns the offset from its pixel center of the sample \a
+	 * sample of the pixel \a pixel, in pixels.
+	 */
+	[[nodiscard]] Eigen::Vector2f subpixel_offset(uint32_t pixel,
+												  uint32_t sample) const;
+
+	// Refines \a buffer for \a budget and returns its image
+	[[nodiscard]] Framebuffer refine_for(const Viewport &vp,
+										 SampleBuffer &buffer,
+										 std::chrono::nanoseconds budget,
+										 RenderStats *stats) const;
+
+	/**
+	 * \brief Returns the offset from its pixel center of the sample \a
+	 * sample of the pixel \a pixel traced by refine(), in pixels.
+	 */
+	[[nodiscard]] Eigen::Vector2f progressive_offset(uint32_t pixel,
+													 uint32_t sample) const;
+
+	/**
+	 * \brief Traces the branch \a path of trace_ray(), see RayQueue.
+	 *
+	 * \param throughput The weight of the color of \a ray in the pixel, the
+	 * product of the weights of the branches leading to it.
+	 */
+	[[nodiscard]] ScaledColor trace_path(const Ray &ray, uint32_t pixel,
+										 uint32_t sample, uint32_t path,
+										 uint8_t bounce_count,
+										 float throughput) const;
+
+	/**
+	 * \brief Returns the number the branch \a path of the sample \a sample
+	 * of the pixel \a pixel plays the Russian roulette with, whichever way
+	 * and in whichever order it is traced.
+	 */
+	[[nodiscard]] float roulette_draw(uint32_t pixel, uint32_t sample,
+									  uint32_t path) const;
+
+	/**
+	 * \brief Returns 0 if the branch carrying \a throughput is culled,
+	 * otherwise the factor its throughput is scaled by.
+	 *
+	 * \param draw Returns the number in [0, 1) the Russian roulette is
+	 * played with, only called if it is played.
+	 */
+	template <class Draw>
+	[[nodiscard]] float branch_scale(float throughput, Draw &&draw) const;
+
 	/**
 	 * \return if the number of light bounces has exceeded the maximum limit.
 	 *
@@ -144,6 +492,17 @@ private:
 	Vector3f orig_;
 	// A limit to how deeply lights may go before it fades away.
 	uint8_t bounce_limit_;
+
+	BranchCulling culling_ = BranchCulling::THRESHOLD;
+	uint64_t seed_         = 0;
+
+	uint32_t samples_per_pixel_ = 1;
+	PixelFilter filter_         = PixelFilter::BOX;
+	float max_error_            = 0.f;
+	uint32_t min_samples_       = 4;
+
+	size_t thread_count_ = std::max(1U, std::thread::hardware_concurrency());
+	size_t tile_size_    = 32;
 };
 
 } // namespace raytracing
@@ -0,0 +1,69 @@
+#include "instance.hpp"
+
+#include "prototype.hpp"
+
+#include <gsl/gsl-lite.hpp>
+#include <limits>
+#include <utility>
+
+namespace raytracing {
+Instance::Instance(std::shared_ptr<const Prototype> prototype,
+				   const Eigen::AffineCompact3f &object_to_world,
+				   const std::optional<Material> &material)
+	: SolidObject(object_to_world,
+				  material.value_or(prototype->parts()[0].get_optics())),
+	  prototype_(std::move(prototype)),
+	  overrides_material_(material.has_value()) {}
+
+float Instance::hit(const Ray &ray) const {
+	uint32_t part = 0;
+	return hit_part(ray, part, nullptr);
+}
+
+float Instance::hit_part(const Ray &ray, uint32_t &part,
+						 TraversalStats *stats) const {
+	const Ray object   = camera_to_object_coordinates(ray);
+	const auto closest = prototype_->parts().find_closest_hit(object, stats);
+	if (!closest.has_value()) return std::numeric_limits<float>::infinity();
+	part = closest->object_id;
+	return closest->root;
+}
+
+bool Instance::contains(Point3fConstRef point) const {
+	return prototype_->parts()
+		.find_any_primary_container(camera_to_object_coordinates(point))
+		.has_value();
+}
+
+Vector3f Instance::normal_at(Point3fConstRef point) const {
+	const Point3f object = camera_to_object_coordinates(point);
+	const auto part = prototype_->parts().find_any_primary_container(object);
+	gsl_Expects(part.has_value());
+	return normal_to_camera_coordinates(part.value()->normal_at(object));
+}
+
+Eigen::AlignedBox3f Instance::bounding_box() const {
+	using Corner            = Eigen::AlignedBox3f::CornerType;
+	const auto &prototype   = prototype_->bounds();
+	Eigen::AlignedBox3f box;
+	for (int corner = 0; corner < 8; ++corner)
+		box.extend(object_to_camera_coordinates(
+			prototype.corner(static_cast<Corner>(corner))));
+	return box;
+}
+
+Intersection Instance::intersection_at(const Ray &ray, float root,
+									   uint32_t part) const {
+	gsl_Expects(part < prototype_->parts().size());
+	const Ray object         = camera_to_object_coordinates(ray);
+	const SolidObject &solid = prototype_->parts()[part];
+	uint32_t nested_part     = 0;
+	if (dynamic_cast<const Instance *>(&solid) != nullptr)
+		(void)solid.hit_part(object, nested_part, nullptr);
+
+	const Intersection hit = solid.intersection_at(object, root, nested_part);
+	return {ray.at(root),
+			normal_to_camera_coordinates(hit.normal),
+			overrides_material_ ? &get_optics() : hit.material};
+}
+} // namespace raytracing
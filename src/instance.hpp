@@ -0,0 +1,83 @@
+#ifndef INSTANCE_HPP
+#define INSTANCE_HPP
+
+#include "intersection.hpp"
+#include "material.hpp"
+#include "point3f.hpp"
+#include "ray.hpp"
+#include "render_stats.hpp"
+#include "solid_object.hpp"
+#include "vector3f.hpp"
+
+#include <Eigen/Geometry>
+#include <cstdint>
+#include <memory>
+#include <optional>
+
+namespace raytracing {
+class Prototype;
+
+/**
+ * \brief A Prototype placed in the scene by its own transform, sharing the
+ * parts and the BVH of the prototype with every other instance of it.
+ *
+ * Rays are taken to the object coordinates of the prototype by
+ * camera_to_object_coordinates() without being normalised, so the roots found
+ * there are the roots along the ray in the scene. An instance only holds its
+ * transform and material besides a pointer, whatever the size of the
+ * prototype.
+ */
+class Instance final : public SolidObject {
+public:
+	/**
+	 * \param object_to_world Places the prototype in the scene, e.g. a
+	 * rotation and a scaling followed by a translation.
+	 * \param material Replaces the materials of every part of the prototype,
+	 * if any. Otherwise, get_optics() is the material of its first part.
+	 */
+	Instance(std::shared_ptr<const Prototype> prototype,
+			 const Eigen::AffineCompact3f &object_to_world,
+			 const std::optional<Material> &material = std::nullopt);
+
+	// Returns the closest root of \a ray on any part of the prototype
+	[[nodiscard]] float hit(const Ray &ray) const override;
+
+	/**
+	 * \brief Returns hit(), with the id of the part of the prototype hit in
+	 * \a part, and the traversal of the BVH of the prototype added to \a
+	 * stats if not null.
+	 */
+	[[nodiscard]] float hit_part(const Ray &ray, uint32_t &part,
+								 TraversalStats *stats) const override;
+
+	[[nodiscard]] bool contains(Point3fConstRef point) const override;
+
+	// Returns the normal of the first part containing \a point
+	[[nodiscard]] Vector3f normal_at(Point3fConstRef point) const override;
+
+	/**
+	 * \brief Returns the box around the corners of the box of the prototype,
+	 * transformed.
+	 */
+	[[nodiscard]] Eigen::AlignedBox3f bounding_box() const override;
+
+	/**
+	 * \brief Returns the intersection with the part \a part of the
+	 * prototype, its normal taken back to camera coordinates.
+	 *
+	 * Only an instance nested in the prototype is hit again, to find its own
+	 * part.
+	 */
+	[[nodiscard]] Intersection intersection_at(const Ray &ray, float root,
+											   uint32_t part) const override;
+
+	[[nodiscard]] const std::shared_ptr<const Prototype> &prototype() const {
+		return prototype_;
+	}
+
+private:
+	std::shared_ptr<const Prototype> prototype_;
+	bool overrides_material_;
+};
+} // namespace raytracing
+#endif /* ifndef INSTANCE_HPP */
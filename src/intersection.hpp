@@ -20,7 +20,7 @@ struct Intersection {
 	Point3f position = Point3f::Zero();
 	Vector3f normal  = -Vector3f::UnitZ();
 
-	Material *material;
+	const Material *material;
 
 	auto operator==(const Intersection &other) const noexcept {
 		if (!position.isApprox(other.position, 1e-2f)) return false;
@@ -0,0 +1,79 @@
+#include "mapped_file.hpp"
+
+#include <cerrno>
+#include <fcntl.h>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <system_error>
+#include <unistd.h>
+#include <utility>
+
+namespace raytracing {
+namespace {
+[[noreturn]] void throw_errno(const std::string &what) {
+	throw std::system_error(errno, std::generic_category(), what);
+}
+
+// Closes the descriptor once mapped, the mapping keeps the file open
+struct FileDescriptor {
+	int fd;
+
+	~FileDescriptor() { ::close(fd); }
+};
+} // namespace
+
+MappedFile::MappedFile(size_t size) {
+	void *data = ::mmap(nullptr, size, PROT_READ | PROT_WRITE,
+						MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (data == MAP_FAILED) throw_errno("Cannot map anonymous memory");
+	data_ = static_cast<std::byte *>(data);
+	size_ = size;
+}
+
+MappedFile::MappedFile(const std::filesystem::path &path, size_t size) {
+	const FileDescriptor file{
+		::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644)};
+	if (file.fd < 0) throw_errno("Cannot create " + path.string());
+	if (::ftruncate(file.fd, static_cast<off_t>(size)) != 0)
+		throw_errno("Cannot resize " + path.string());
+	map(file.fd, size);
+}
+
+MappedFile::MappedFile(const std::filesystem::path &path) {
+	const FileDescriptor file{::open(path.c_str(), O_RDWR)};
+	if (file.fd < 0) throw_errno("Cannot open " + path.string());
+	struct stat status {};
+	if (::fstat(file.fd, &status) != 0)
+		throw_errno("Cannot stat " + path.string());
+	map(file.fd, static_cast<size_t>(status.st_size));
+}
+
+MappedFile::MappedFile(MappedFile &&other) noexcept
+	: data_(std::exchange(other.data_, nullptr)),
+	  size_(std::exchange(other.size_, 0)), anonymous_(other.anonymous_) {}
+
+MappedFile &MappedFile::operator=(MappedFile &&other) noexcept {
+	std::swap(data_, other.data_);
+	std::swap(size_, other.size_);
+	std::swap(anonymous_, other.anonymous_);
+	return *this;
+}
+
+MappedFile::~MappedFile() {
+	if (data_ != nullptr) ::munmap(data_, size_);
+}
+
+void MappedFile::sync() const {
+	if (!anonymous_ && data_ != nullptr) ::msync(data_, size_, MS_ASYNC);
+}
+
+void MappedFile::map(int fd, size_t size) {
+	void *data
+		= ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (data == MAP_FAILED) throw_errno("Cannot map the file");
+	data_      = static_cast<std::byte *>(data);
+	size_      = size;
+	anonymous_ = false;
+}
+} // namespace raytracing
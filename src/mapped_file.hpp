@@ -0,0 +1,51 @@
+#ifndef MAPPED_FILE_HPP
+#define MAPPED_FILE_HPP
+
+#include <cstddef>
+#include <filesystem>
+#include <span>
+
+namespace raytracing {
+/**
+ * \brief A file mapped into memory in whole, shared with the page cache so
+ * that every write to bytes() reaches the file without any copy, even if the
+ * process is killed afterwards.
+ *
+ * Without a file, the memory is anonymous and lost once unmapped.
+ *
+ * \throws std::system_error if the file cannot be opened or mapped.
+ */
+class MappedFile {
+public:
+	// Maps \a size bytes of anonymous memory, all zero
+	explicit MappedFile(size_t size);
+
+	// Creates or truncates the file \a path to \a size bytes, all zero
+	MappedFile(const std::filesystem::path &path, size_t size);
+
+	// Maps the existing file \a path as it is
+	explicit MappedFile(const std::filesystem::path &path);
+
+	MappedFile(const MappedFile &)            = delete;
+	MappedFile &operator=(const MappedFile &) = delete;
+	MappedFile(MappedFile &&other) noexcept;
+	MappedFile &operator=(MappedFile &&other) noexcept;
+	~MappedFile();
+
+	[[nodiscard]] std::span<std::byte> bytes() const { return {data_, size_}; }
+
+	/**
+	 * \brief Schedules the pages written so far to be written back to the
+	 * file, without waiting for it.
+	 */
+	void sync() const;
+
+private:
+	void map(int fd, size_t size);
+
+	std::byte *data_ = nullptr;
+	size_t size_     = 0;
+	bool anonymous_  = true;
+};
+} // namespace raytracing
+#endif /* ifndef MAPPED_FILE_HPP */
@@ -37,6 +37,8 @@ public:
 		return *container_[i].get();
 	}
 
+	element_type &operator[](size_t i) { return *container_[i].get(); }
+
 	constexpr auto transform(std::invocable<element_type> auto &&op) const {
 		return container_
 			   | std::ranges::transform(std::forward<decltype(op)>(op));
@@ -52,7 +54,7 @@ public:
 		const auto result
 			= std::ranges::find_if(container_,
 								   std::forward<decltype(pred)>(pred));
-		if (result != std::ranges::end(container_)) return std::nullopt;
+		if (result == std::ranges::end(container_)) return std::nullopt;
 		return (*result).get();
 	}
 
@@ -0,0 +1,42 @@
+#ifndef PROTOTYPE_HPP
+#define PROTOTYPE_HPP
+
+#include "bvh.hpp"
+#include "solid_object_list.hpp"
+
+#include <Eigen/Geometry>
+#include <gsl/gsl-lite.hpp>
+#include <utility>
+
+namespace raytracing {
+/**
+ * \brief The parts of an asset repeated across a scene, in object
+ * coordinates, with a bottom-level BVH over them built once.
+ *
+ * Every Instance of it shares it through a std::shared_ptr, so the memory and
+ * the build time grow with the unique geometry, not with the number of
+ * instances. The BVH of the scene over the instances is the top level.
+ */
+class Prototype {
+public:
+	explicit Prototype(SolidObjectList parts,
+					   BvhBuilder builder = BvhBuilder::BINNED_SAH,
+					   BvhLayout layout   = BvhLayout::BINARY)
+		: parts_(std::move(parts)) {
+		gsl_Expects(parts_.size() > 0);
+		parts_.build_bvh(builder, layout);
+		for (size_t id = 0; id < parts_.size(); ++id)
+			bounds_.extend(parts_[id].bounding_box());
+	}
+
+	[[nodiscard]] const SolidObjectList &parts() const { return parts_; }
+
+	// The box of every part, in object coordinates
+	[[nodiscard]] const Eigen::AlignedBox3f &bounds() const { return bounds_; }
+
+private:
+	SolidObjectList parts_;
+	Eigen::AlignedBox3f bounds_;
+};
+} // namespace raytracing
+#endif /* ifndef PROTOTYPE_HPP */
@@ -1,33 +1,110 @@
 #include "random.hpp"
 
+#include <atomic>
+#include <cmath>
 #include <gsl/gsl-lite.hpp>
 #include <random>
 
 namespace raytracing {
-float random_float(float from, float upto) {
+namespace {
+constexpr uint32_t PHILOX_M0 = 0xD2511F53;
+constexpr uint32_t PHILOX_M1 = 0xCD9E8D57;
+constexpr uint32_t PHILOX_W0 = 0x9E3779B9;
+constexpr uint32_t PHILOX_W1 = 0xBB67AE85;
+constexpr int PHILOX_ROUNDS  = 10;
+
+// Distinguishes the threads seeded from the same std::random_device draw
+std::atomic<uint32_t> thread_count{0};
+
+Rng make_thread_rng() {
+	std::random_device device;
+	const uint64_t seed = (static_cast<uint64_t>(device()) << 32) | device();
+	return {seed, 0, thread_count++};
+}
+} // namespace
+
+Rng::Counter Rng::philox(Counter counter, Key key) {
+	for (int round = 0; round < PHILOX_ROUNDS; ++round) {
+		const uint64_t p0 = static_cast<uint64_t>(PHILOX_M0) * counter[0];
+		const uint64_t p1 = static_cast<uint64_t>(PHILOX_M1) * counter[2];
+		counter = {static_cast<uint32_t>(p1 >> 32) ^ counter[1] ^ key[0],
+				   static_cast<uint32_t>(p1),
+				   static_cast<uint32_t>(p0 >> 32) ^ counter[3] ^ key[1],
+				   static_cast<uint32_t>(p0)};
+		key[0] += PHILOX_W0;
+		key[1] += PHILOX_W1;
+	}
+	return counter;
+}
+
+float Rng::uniform(float from, float upto) {
+	const float x = from + (upto - from) * next_float();
+	// Rounding may land on upto itself
+	return x < upto ? x : std::nextafter(upto, from);
+}
+
+void Rng::fill(std::span<float> out, float from, float upto) {
 	gsl_Expects(from < upto);
-	static std::mt19937 gen(std::random_device{}());
+	const float scale = upto - from;
+	const float below = std::nextafter(upto, from);
+
+	const size_t width = block_.size();
+	for (size_t i = 0; i < out.size(); i += width) {
+		const Counter block = philox(counter_, key_);
+		next_block();
+		for (size_t j = 0; j < width && i + j < out.size(); ++j) {
+			const float x = from + scale * to_unit_float(block[j]);
+			out[i + j]    = x < upto ? x : below;
+		}
+	}
+	used_ = block_.size();
+}
 
-	static std::uniform_real_distribution<float> dist;
-	using parm_t = decltype(dist)::param_type;
-	return dist(gen, parm_t{from, upto});
+Rng &thread_rng() {
+	thread_local Rng rng = make_thread_rng();
+	return rng;
+}
+
+void seed_thread_rng(uint64_t seed, uint32_t pixel, uint32_t sample) {
+	thread_rng() = Rng{seed, pixel, sample};
+}
+
+float random_float(float from, float upto) {
+	gsl_Expects(from < upto);
+	return thread_rng().uniform(from, upto);
 }
 
 Vector3f random_vector(float from, float upto) {
-	return Vector3f::NullaryExpr(
-		[from, upto] { return random_float(from, upto); });
+	return random_vector(thread_rng(), from, upto);
+}
+
+Vector3f random_vector(Rng &rng, float from, float upto) {
+	gsl_Expects(from < upto);
+	// Drawn in order, Eigen does not specify the order of NullaryExpr calls
+	const float x = rng.uniform(from, upto);
+	const float y = rng.uniform(from, upto);
+	const float z = rng.uniform(from, upto);
+	return {x, y, z};
 }
 
 Vector3f random_unit_vector(float from, float upto) {
-	return Vector3f::NullaryExpr(
-			   [from, upto] { return random_float(from, upto); })
-		.normalized();
+	return random_unit_vector(thread_rng(), from, upto);
+}
+
+Vector3f random_unit_vector(Rng &rng, float from, float upto) {
+	return random_vector(rng, from, upto).normalized();
 }
 
 Eigen::Vector2f random_in_unit_disk() {
+	return random_in_unit_disk(thread_rng());
+}
+
+Eigen::Vector2f random_in_unit_disk(Rng &rng) {
 	using Eigen::Vector2f;
 	while (true) {
-		Vector2f p = Vector2f::NullaryExpr([] { return random_float(-1, 1); });
+		const float x = rng.uniform(-1, 1);
+		const float y = rng.uniform(-1, 1);
+		Vector2f p{x, y};
 
 		if (p.squaredNorm() < 1.f) return p;
 	}
@@ -3,7 +3,95 @@
 
 #include "vector3f.hpp"
 
+#include <array>
+#include <cstdint>
+#include <span>
+
 namespace raytracing {
+/**
+ * \brief A counter-based random number generator, Philox4x32-10 from
+ * "Parallel random numbers: as easy as 1, 2, 3" (Salmon et al., 2011).
+ *
+ * Every block of 4 numbers is a pure function of a 128-bit counter and a
+ * 64-bit key, so any sample of any pixel can be drawn directly and in any
+ * order, from any thread: the key is the seed of the render, the counter holds
+ * the pixel, the sample and the index of the block within the sample.
+ */
+class Rng {
+public:
+	using Counter = std::array<uint32_t, 4>;
+	using Key     = std::array<uint32_t, 2>;
+
+	explicit Rng(uint64_t seed = 0) : Rng(seed, 0, 0) {}
+
+	/**
+	 * \brief Returns the numbers of the sample \a sample of the pixel \a
+	 * pixel, the same ones on every run with the same \a seed.
+	 */
+	Rng(uint64_t seed, uint32_t pixel, uint32_t sample)
+		: key_{static_cast<uint32_t>(seed), static_cast<uint32_t>(seed >> 32)},
+		  counter_{0, 0, pixel, sample} {}
+
+	[[nodiscard]] static Counter philox(Counter counter, Key key);
+
+	uint32_t next_uint() {
+		if (used_ == block_.size()) {
+			block_ = philox(counter_, key_);
+			next_block();
+			used_ = 0;
+		}
+		return block_[used_++];
+	}
+
+	/**
+	 * \brief Returns a number uniformly distributed in [0, 1), with 24
+	 * random bits.
+	 */
+	float next_float() { return to_unit_float(next_uint()); }
+
+	/**
+	 * \brief Returns a number uniformly distributed in [from, upto).
+	 */
+	float uniform(float from, float upto);
+
+	/**
+	 * \brief Fills \a out with numbers uniformly distributed in [from, upto).
+	 *
+	 * The blocks are independent of each other, so they are generated in a
+	 * loop the compiler vectorises, many at once. The numbers are those of
+	 * the next blocks, as if drawn one by one after discarding what is left
+	 * of the current block.
+	 */
+	void fill(std::span<float> out, float from = 0.f, float upto = 1.f);
+
+	[[nodiscard]] static float to_unit_float(uint32_t x) {
+		return static_cast<float>(x >> 8) * 0x1p-24f;
+	}
+
+private:
+	void next_block() {
+		if (++counter_[0] == 0) ++counter_[1];
+	}
+
+	Key key_;
+	Counter counter_;
+	Counter block_{};
+	size_t used_ = block_.size();
+};
+
+/**
+ * \brief Returns the generator of the calling thread, used by every function
+ * below. It is seeded from std::random_device until seed_thread_rng() is
+ * called.
+ */
+Rng &thread_rng();
+
+/**
+ * \brief Restarts the generator of the calling thread at the sample \a sample
+ * of the pixel \a pixel, making what follows deterministic whichever thread
+ * renders the pixel.
+ */
+void seed_thread_rng(uint64_t seed, uint32_t pixel, uint32_t sample);
 
 /**
  * \brief Returns a random number ranging between [from, upto) using uniform
@@ -14,18 +102,23 @@ namespace raytracing {
 float random_float(float from = 0.f, float upto = 1.f);
 
 /**
- * \brief A custom random function returning an Eigen::Vector3f using C++11
- * std::uniform_real_distribution, instead of rand() in
- * Eigen::Vector3f::Random(). Furthermore, to specify a user-defined range of
- * values, instead of only [0,1).
+ * \brief A custom random function returning an Eigen::Vector3f uniformly
+ * distributed in [from, upto) on every axis, instead of rand() in
+ * Eigen::Vector3f::Random().
  * */
 Vector3f random_vector(float from = 0.f, float upto = 1.f);
 
+Vector3f random_vector(Rng &rng, float from = 0.f, float upto = 1.f);
+
 /**
  * \brief Returns a random normalised vector
  */
 Vector3f random_unit_vector(float from = -10.f, float upto = 10.f);
 
+Vector3f random_unit_vector(Rng &rng, float from = -10.f, float upto = 10.f);
+
 Eigen::Vector2f random_in_unit_disk();
+
+Eigen::Vector2f random_in_unit_disk(Rng &rng);
 } // namespace raytracing
 #endif /* ifndef RANDOM_HPP */
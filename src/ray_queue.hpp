@@ -0,0 +1,120 @@
+#ifndef RAY_QUEUE_HPP
+#define RAY_QUEUE_HPP
+
+#include "color.hpp"
+#include "ray.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+namespace raytracing {
+/**
+ * \brief The rays waiting for the same stage of the wavefront integrator,
+ * stored as a structure of arrays.
+ *
+ * Every ray carries the pixel it contributes to, its throughput, i.e. the
+ * weight of its color in that pixel, its path in the tree of rays of that
+ * pixel and the root past which hits are ignored, infinity except for shadow
+ * rays.
+ */
+class RayQueue {
+public:
+	/**
+	 * \param path 1 for a primary ray, then twice the path of the ray it
+	 * branches from, plus 1 if it is the refracted branch, so that no two
+	 * rays of a pixel share it.
+	 */
+	void push(const Ray &ray, float throughput, uint32_t pixel,
+			  uint32_t path = 1,
+			  float t_max   = std::numeric_limits<float>::infinity()) {
+		for (int axis = 0; axis < 3; ++axis) {
+			origin_[axis].push_back(ray.origin[axis]);
+			direction_[axis].push_back(ray.direction[axis]);
+		}
+		throughput_.push_back(throughput);
+		pixel_.push_back(pixel);
+		path_.push_back(path);
+		t_max_.push_back(t_max);
+	}
+
+	/**
+	 * \brief Pushes a shadow ray, whose \a color reaches \a pixel unless an
+	 * obstacle lies before \a t_max.
+	 */
+	void push_shadow(const Ray &ray, float t_max, ScaledColorConstRef color,
+					 uint32_t pixel) {
+		push(ray, 1.f, pixel, 0, t_max);
+		color_.push_back(color);
+	}
+
+	[[nodiscard]] Ray ray(size_t i) const {
+		return {Point3f{origin_[0][i], origin_[1][i], origin_[2][i]},
+				Vector3f{direction_[0][i], direction_[1][i], direction_[2][i]}};
+	}
+
+	[[nodiscard]] float throughput(size_t i) const { return throughput_[i]; }
+
+	[[nodiscard]] uint32_t pixel(size_t i) const { return pixel_[i]; }
+
+	[[nodiscard]] uint32_t path(size_t i) const { return path_[i]; }
+
+	[[nodiscard]] float t_max(size_t i) const { return t_max_[i]; }
+
+	[[nodiscard]] const ScaledColor &color(size_t i) const {
+		return color_[i];
+	}
+
+	[[nodiscard]] size_t size() const { return pixel_.size(); }
+
+	[[nodiscard]] bool empty() const { return pixel_.empty(); }
+
+	// Keeps the capacity, so a queue reused stage after stage stops
+	// allocating once it has grown to its largest size.
+	void clear() {
+		for (int axis = 0; axis < 3; ++axis) {
+			origin_[axis].clear();
+			direction_[axis].clear();
+		}
+		throughput_.clear();
+		pixel_.clear();
+		path_.clear();
+		t_max_.clear();
+		color_.clear();
+	}
+
+	// Drops the rays past the first \a size, keeping the capacity as well
+	void truncate(size_t size) {
+		for (int axis = 0; axis < 3; ++axis) {
+			origin_[axis].resize(size);
+			direction_[axis].resize(size);
+		}
+		throughput_.resize(size);
+		pixel_.resize(size);
+		path_.resize(size);
+		t_max_.resize(size);
+		color_.resize(std::min(color_.size(), size));
+	}
+
+	void swap(RayQueue &other) noexcept {
+		origin_.swap(other.origin_);
+		direction_.swap(other.direction_);
+		throughput_.swap(other.throughput_);
+		pixel_.swap(other.pixel_);
+		path_.swap(other.path_);
+		t_max_.swap(other.t_max_);
+		color_.swap(other.color_);
+	}
+
+private:
+	std::array<std::vector<float>, 3> origin_, direction_;
+	std::vector<float> throughput_;
+	std::vector<uint32_t> pixel_;
+	std::vector<uint32_t> path_;
+	std::vector<float> t_max_;
+	std::vector<ScaledColor> color_; // Of shadow rays only
+};
+} // namespace raytracing
+#endif /* ifndef RAY_QUEUE_HPP */
@@ -12,6 +12,8 @@ struct Rect {
 	}
 
 	[[nodiscard]] constexpr size_t area() const { return width * height; }
+
+	constexpr bool operator==(const Rect &other) const = default;
 };
 } // namespace raytracing
 #endif /* ifndef RECT_HPP */
@@ -0,0 +1,60 @@
+#include "render_stats.hpp"
+
+#include <fmt/ranges.h>
+#include <span>
+
+namespace raytracing {
+RenderStats &RenderStats::operator+=(const RenderStats &other) {
+	primary_rays += other.primary_rays;
+	secondary_rays += other.secondary_rays;
+	shadow_rays += other.shadow_rays;
+	primitive_tests += other.primitive_tests;
+	bvh_node_visits += other.bvh_node_visits;
+	early_terminations += other.early_terminations;
+	for (size_t depth = 0; depth < MAX_DEPTH; ++depth)
+		depth_histogram[depth] += other.depth_histogram[depth];
+	return *this;
+}
+
+std::string to_json(const RenderStats &stats) {
+	// Leave out the depths no ray reached
+	size_t depth_count = RenderStats::MAX_DEPTH;
+	while (depth_count > 0 && stats.depth_histogram[depth_count - 1] == 0)
+		--depth_count;
+
+	return fmt::format(R"({{
+  "primary_rays": {},
+  "secondary_rays": {},
+  "shadow_rays": {},
+  "total_rays": {},
+  "primitive_tests": {},
+  "primitive_tests_per_ray": {},
+  "bvh_node_visits": {},
+  "early_terminations": {},
+  "depth_histogram": [{}],
+  "samples_per_pixel": {},
+  "seconds": {},
+  "mrays_per_second": {}
+}}
+)",
+					   stats.primary_rays,
+					   stats.secondary_rays,
+					   stats.shadow_rays,
+					   stats.total_rays(),
+					   stats.primitive_tests,
+					   stats.primitive_tests_per_ray(),
+					   stats.bvh_node_visits,
+					   stats.early_terminations,
+					   fmt::join(std::span{stats.depth_histogram}.first(
+									 depth_count),
+								 ", "),
+					   stats.samples_per_pixel,
+					   stats.seconds,
+					   stats.mrays_per_second());
+}
+
+void write_json(fmt::cstring_view filename, const RenderStats &stats) {
+	auto file = fmt::output_file(filename.c_str());
+	file.print("{}", to_json(stats));
+}
+} // namespace raytracing
@@ -0,0 +1,89 @@
+#ifndef RENDER_STATS_HPP
+#define RENDER_STATS_HPP
+
+#include <array>
+#include <cstdint>
+#include <fmt/os.h>
+#include <string>
+
+namespace raytracing {
+/**
+ * \brief The work done by a single query of an acceleration structure.
+ */
+struct TraversalStats {
+	uint64_t node_visits     = 0;
+	uint64_t primitive_tests = 0; // Calls of SolidObject::hit() or the like
+
+	TraversalStats &operator+=(const TraversalStats &other) {
+		node_visits += other.node_visits;
+		primitive_tests += other.primitive_tests;
+		return *this;
+	}
+};
+
+/**
+ * \brief Counters filled while rendering an image, to tell where the time
+ * goes and how many rays a scene costs.
+ *
+ * Every tile fills its own copy, merged with operator+=() once all are done,
+ * so the threads never share a counter.
+ */
+struct RenderStats {
+	// ImageRenderer limits the number of bounces below this
+	static constexpr size_t MAX_DEPTH = 20;
+
+	uint64_t primary_rays   = 0;
+	uint64_t secondary_rays = 0; // Reflected and refracted
+	uint64_t shadow_rays    = 0;
+
+	uint64_t primitive_tests = 0;
+	uint64_t bvh_node_visits = 0;
+
+	// The branches culled or lost at the Russian roulette before reaching the
+	// bounce limit
+	uint64_t early_terminations = 0;
+
+	// How many rays are traced at every bounce, the primary ones at 0
+	std::array<uint64_t, MAX_DEPTH> depth_histogram{};
+
+	double seconds = 0.0; // Wall-clock time of the whole render
+	// Traced on average, set once for the whole render like the time
+	double samples_per_pixel = 0.0;
+
+	[[nodiscard]] uint64_t total_rays() const {
+		return primary_rays + secondary_rays + shadow_rays;
+	}
+
+	[[nodiscard]] double mrays_per_second() const {
+		if (seconds <= 0.0) return 0.0;
+		return static_cast<double>(total_rays()) / seconds * 1e-6;
+	}
+
+	[[nodiscard]] double primitive_tests_per_ray() const {
+		if (total_rays() == 0) return 0.0;
+		return static_cast<double>(primitive_tests)
+			   / static_cast<double>(total_rays());
+	}
+
+	void add(const TraversalStats &traversal) {
+		bvh_node_visits += traversal.node_visits;
+		primitive_tests += traversal.primitive_tests;
+	}
+
+	/**
+	 * \brief Adds up every counter of \a other, but keeps the elapsed time
+	 * and the samples per pixel, which are measured once for the whole
+	 * render.
+	 */
+	RenderStats &operator+=(const RenderStats &other);
+};
+
+/**
+ * \brief Returns the counters of \a stats, with the rates derived from them,
+ * as a JSON object.
+ */
+[[nodiscard]] std::string to_json(const RenderStats &stats);
+
+void write_json(fmt::cstring_view filename, const RenderStats &stats);
+} // namespace raytracing
+#endif /* ifndef RENDER_STATS_HPP */
@@ -0,0 +1,117 @@
+#include "sample_buffer.hpp"
+
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <numeric>
+#include <stdexcept>
+#include <utility>
+
+namespace raytracing {
+namespace {
+constexpr char MAGIC[8] = "RTSAMPL";
+
+// Every array of the samples stays aligned on its elements
+static_assert(sizeof(ScaledColor) % alignof(uint32_t) == 0);
+} // namespace
+
+SampleBuffer::SampleBuffer(Rect dimension)
+	: SampleBuffer(MappedFile{storage_size(dimension)}) {
+	init(dimension, 0, 0);
+}
+
+SampleBuffer::SampleBuffer(const std::filesystem::path &checkpoint,
+						   Rect dimension, uint64_t seed, uint32_t tile_size)
+	: SampleBuffer(MappedFile{checkpoint, storage_size(dimension)}) {
+	init(dimension, seed, tile_size);
+	sync();
+}
+
+SampleBuffer SampleBuffer::resume(const std::filesystem::path &checkpoint) {
+	MappedFile storage{checkpoint};
+	const auto bytes = storage.bytes();
+	if (bytes.size() < sizeof(Header)
+		|| std::memcmp(bytes.data(), MAGIC, sizeof(MAGIC)) != 0)
+		throw std::runtime_error(checkpoint.string()
+								 + " is not a sample buffer");
+
+	SampleBuffer buffer{std::move(storage)};
+	if (bytes.size() != storage_size(buffer.dimension()))
+		throw std::runtime_error(checkpoint.string() + " is truncated");
+	buffer.lay_out();
+	return buffer;
+}
+
+SampleBuffer::SampleBuffer(MappedFile storage)
+	: storage_(std::move(storage)),
+	  header_(reinterpret_cast<Header *>(storage_.bytes().data())) {}
+
+size_t SampleBuffer::storage_size(Rect dimension) {
+	return sizeof(Header)
+		 + dimension.area()
+			   * (sizeof(uint32_t) + 2 * sizeof(ScaledColor));
+}
+
+void SampleBuffer::init(Rect dimension, uint64_t seed, uint32_t tile_size) {
+	// The storage starts all zero, as are the samples
+	std::memcpy(header_->magic, MAGIC, sizeof(MAGIC));
+	header_->width  = dimension.width;
+	header_->height = dimension.height;
+	header_->seed      = seed;
+	header_->tile_size = tile_size;
+	lay_out();
+}
+
+void SampleBuffer::lay_out() {
+	const size_t area = dimension().area();
+	std::byte *data   = storage_.bytes().data() + sizeof(Header);
+	counts_           = {reinterpret_cast<uint32_t *>(data), area};
+	data += area * sizeof(uint32_t);
+	means_ = {reinterpret_cast<ScaledColor *>(data), area};
+	data += area * sizeof(ScaledColor);
+	m2_ = {reinterpret_cast<ScaledColor *>(data), area};
+}
+
+Framebuffer SampleBuffer::image() const {
+	Framebuffer image{dimension()};
+	for (size_t j = 0; j < dimension().height; ++j)
+		for (size_t i = 0; i < dimension().width; ++i)
+			image.at(i, j) = mean(i, j);
+	return image;
+}
+
+void SampleBuffer::add_sample(size_t i, size_t j, const ScaledColor &color) {
+	const size_t k   = index(i, j);
+	const uint32_t n = counts_[k] + 1;
+	// Overwrites any preview, which is no sample
+	ScaledColor mean = color;
+	ScaledColor m2   = ScaledColor::Zero();
+	if (n > 1) {
+		const ScaledColor delta = color - means_[k];
+		mean                    = means_[k] + delta / static_cast<float>(n);
+		m2                      = m2_[k] + delta.cwiseProduct(color - mean);
+	}
+
+	// The count is stored last, so it never counts a sample the mean lacks.
+	// A process killed in between still leaves the sample in the mean of
+	// this one pixel without its count, which no ordering can avoid.
+	means_[k] = mean;
+	m2_[k]    = m2;
+	std::atomic_ref{counts_[k]}.store(n, std::memory_order_release);
+}
+
+float SampleBuffer::standard_error(size_t i, size_t j) const {
+	const size_t k = index(i, j);
+	const auto n   = static_cast<float>(counts_[k]);
+	if (n < 2.f) return std::numeric_limits<float>::infinity();
+	return std::sqrt(m2_[k].maxCoeff() / (n * (n - 1.f)));
+}
+
+double SampleBuffer::samples_per_pixel() const {
+	if (counts_.empty()) return 0.0;
+	return static_cast<double>(
+			   std::accumulate(counts_.begin(), counts_.end(), uint64_t{0}))
+		 / static_cast<double>(counts_.size());
+}
+} // namespace raytracing
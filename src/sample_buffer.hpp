@@ -0,0 +1,140 @@
+#ifndef SAMPLE_BUFFER_HPP
+#define SAMPLE_BUFFER_HPP
+
+#include "color.hpp"
+#include "framebuffer.hpp"
+#include "mapped_file.hpp"
+#include "rect.hpp"
+
+#include <cstdint>
+#include <filesystem>
+#include <span>
+
+namespace raytracing {
+/**
+ * \brief The samples traced so far through every pixel of an image, kept as
+ * a running mean and variance so that more can be added at any time.
+ *
+ * ImageRenderer::refine() adds to it pass after pass, image() is a complete
+ * picture after every one of them.
+ *
+ * Kept in a checkpoint file, every sample reaches the file through a
+ * MappedFile as it is added, so that resume() picks up where a crash or the
+ * end of a budget left off. The file holds the seed, the tile size and the
+ * number of passes refine() goes on from, in the byte order of the machine.
+ */
+class SampleBuffer {
+public:
+	// Keeps the samples in memory only
+	explicit SampleBuffer(Rect dimension);
+
+	/**
+	 * \brief Keeps the samples in the file \a checkpoint, created or
+	 * truncated, of a render with the seed \a seed in tiles of \a
+	 * tile_size pixels.
+	 */
+	SampleBuffer(const std::filesystem::path &checkpoint, Rect dimension,
+				 uint64_t seed, uint32_t tile_size);
+
+	/**
+	 * \brief Maps the samples kept in the file \a checkpoint to go on adding
+	 * to them.
+	 *
+	 * \throws std::runtime_error if the file holds no sample buffer.
+	 */
+	[[nodiscard]] static SampleBuffer resume(
+		const std::filesystem::path &checkpoint);
+
+	[[nodiscard]] Rect dimension() const {
+		return {header_->width, header_->height};
+	}
+
+	// The seed of the render, 0 unless kept in a checkpoint file
+	[[nodiscard]] uint64_t seed() const { return header_->seed; }
+
+	// The tile size of the render, 0 unless kept in a checkpoint file
+	[[nodiscard]] uint32_t tile_size() const { return header_->tile_size; }
+
+	/**
+	 * \brief Returns the mean color of the pixel (i, j), or a preview of it
+	 * without any sample yet, traced through its center or copied from a
+	 * nearby pixel.
+	 */
+	[[nodiscard]] const ScaledColor &mean(size_t i, size_t j) const {
+		return means_[index(i, j)];
+	}
+
+	[[nodiscard]] ScaledColor &mean(size_t i, size_t j) {
+		return means_[index(i, j)];
+	}
+
+	// Returns a copy of the mean() of every pixel
+	[[nodiscard]] Framebuffer image() const;
+
+	[[nodiscard]] uint32_t count(size_t i, size_t j) const {
+		return counts_[index(i, j)];
+	}
+
+	[[nodiscard]] std::span<const uint32_t> counts() const { return counts_; }
+
+	/**
+	 * \brief Adds \a color to the mean of the pixel (i, j) with Welford's
+	 * algorithm, exact for the first sample.
+	 */
+	void add_sample(size_t i, size_t j, const ScaledColor &color);
+
+	/**
+	 * \brief Returns the largest standard error of the mean over the channels
+	 * of the pixel (i, j), infinity with fewer than 2 samples.
+	 */
+	[[nodiscard]] float standard_error(size_t i, size_t j) const;
+
+	/**
+	 * \brief Returns the number of samples traced per pixel, on average.
+	 */
+	[[nodiscard]] double samples_per_pixel() const;
+
+	// The passes of ImageRenderer::refine() completed over the whole image
+	[[nodiscard]] uint32_t passes() const { return header_->passes; }
+
+	void set_passes(uint32_t passes) { header_->passes = passes; }
+
+	/**
+	 * \brief Schedules the samples added so far to be written to the
+	 * checkpoint file, without waiting for it.
+	 */
+	void sync() const { storage_.sync(); }
+
+private:
+	struct Header {
+		char magic[8];
+		uint64_t width, height;
+		uint64_t seed;
+		uint32_t passes;
+		uint32_t tile_size;
+	};
+
+	// Finds the header at the start of \a storage
+	explicit SampleBuffer(MappedFile storage);
+
+	[[nodiscard]] static size_t storage_size(Rect dimension);
+
+	// Writes a header for an image of \a dimension, then lay_out()
+	void init(Rect dimension, uint64_t seed, uint32_t tile_size);
+
+	// Points the arrays of the samples past the header
+	void lay_out();
+
+	[[nodiscard]] size_t index(size_t i, size_t j) const {
+		return j * header_->width + i;
+	}
+
+	MappedFile storage_;
+	Header *header_;
+	std::span<uint32_t> counts_;
+	std::span<ScaledColor> means_;
+	// The sums of the squared deviations from the mean, per channel
+	std::span<ScaledColor> m2_;
+};
+} // namespace raytracing
+#endif /* ifndef SAMPLE_BUFFER_HPP */
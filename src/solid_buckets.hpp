@@ -0,0 +1,259 @@
+#ifndef SOLID_BUCKETS_HPP
+#define SOLID_BUCKETS_HPP
+
+#include "hit_record.hpp"
+#include "point3f.hpp"
+#include "ray.hpp"
+#include "render_stats.hpp"
+#include "solid_object.hpp"
+#include "sphere.hpp"
+#include "sphere_store.hpp"
+
+#include <algorithm>
+#include <concepts>
+#include <cstdint>
+#include <gsl/gsl-lite.hpp>
+#include <optional>
+#include <span>
+#include <tuple>
+#include <typeinfo>
+#include <utility>
+#include <vector>
+
+namespace raytracing {
+/**
+ * \brief A contiguous array of solid objects of the same concrete type, each
+ * tagged with the index of the object in its SolidObjectList.
+ *
+ * \a Solid is final, so the calls below are resolved at compile time rather
+ * than through the virtual table of every object.
+ */
+template <std::derived_from<SolidObject> Solid> class SolidArray {
+public:
+	static_assert(std::is_final_v<Solid>,
+				  "Only final types are devirtualised by the compiler");
+
+	void push_back(const Solid &solid, uint32_t id) {
+		solids_.push_back(solid);
+		ids_.push_back(id);
+	}
+
+	void clear() {
+		solids_.clear();
+		ids_.clear();
+	}
+
+	[[nodiscard]] size_t size() const { return solids_.size(); }
+
+	[[nodiscard]] const Solid &operator[](size_t i) const { return solids_[i]; }
+
+	/**
+	 * \brief Calls \a transform with the \a i -th solid as a SolidObject, to
+	 * move it.
+	 */
+	template <class Transform> void transform(size_t i, Transform &transform) {
+		transform(static_cast<SolidObject &>(solids_[i]));
+	}
+
+	void find_closest(const Ray &ray, HitRecord &closest,
+					  TraversalStats *stats) const {
+		for (size_t i = 0; i < solids_.size(); ++i) {
+			uint32_t part    = 0;
+			const float root = solids_[i].hit_part(ray, part, stats);
+			closest.keep_closest(root, ids_[i], part);
+		}
+	}
+
+	[[nodiscard]] bool any_hit(const Ray &ray, float t_max,
+							   TraversalStats *stats) const {
+		return std::ranges::any_of(solids_, [&](const Solid &solid) {
+			uint32_t part = 0;
+			return solid.hit_part(ray, part, stats) < t_max;
+		});
+	}
+
+	/**
+	 * \brief Returns the id of the first solid containing \a point, if any.
+	 */
+	[[nodiscard]] std::optional<uint32_t>
+	find_container(Point3fConstRef point) const {
+		for (size_t i = 0; i < solids_.size(); ++i)
+			if (solids_[i].contains(point)) return ids_[i];
+		return std::nullopt;
+	}
+
+private:
+	std::vector<Solid> solids_;
+	std::vector<uint32_t> ids_;
+};
+
+template <class Solid> class SolidBucket : public SolidArray<Solid> {};
+
+/**
+ * \brief Spheres are also packed into a SphereStore, which intersects them in
+ * SIMD batches.
+ */
+template <> class SolidBucket<Sphere> : public SolidArray<Sphere> {
+public:
+	void push_back(const Sphere &sphere, uint32_t id) {
+		SolidArray::push_back(sphere, id);
+		packed_.push_back(sphere.center(), sphere.radius(), id);
+	}
+
+	void clear() {
+		SolidArray::clear();
+		packed_.clear();
+	}
+
+	template <class Transform> void transform(size_t i, Transform &transform) {
+		SolidArray::transform(i, transform);
+		packed_.set(i, (*this)[i].center(), (*this)[i].radius());
+	}
+
+	void find_closest(const Ray &ray, HitRecord &closest,
+					  TraversalStats * /*stats*/) const {
+		const auto [root, id] = packed_.find_closest(ray);
+		closest.keep_closest(root, id);
+	}
+
+	[[nodiscard]] bool any_hit(const Ray &ray, float t_max,
+							   TraversalStats * /*stats*/) const {
+		return packed_.any_hit(ray, t_max);
+	}
+
+private:
+	SphereStore packed_;
+};
+
+/**
+ * \brief One SolidBucket per type in \a Solids, held in a tuple, so every
+ * query runs over each homogeneous array in turn without any indirection.
+ */
+template <std::derived_from<SolidObject>... Solids> class SolidBuckets {
+public:
+	static constexpr size_t TYPE_COUNT = sizeof...(Solids);
+
+	/**
+	 * \brief Where an object lives: the index of its bucket, in the order of
+	 * \a Solids, and its index in that bucket.
+	 */
+	struct Location {
+		uint32_t bucket;
+		uint32_t index;
+	};
+
+	template <class Solid>
+		requires(std::same_as<Solid, Solids> || ...)
+	Location push_back(const Solid &solid, uint32_t id) {
+		auto &bucket = std::get<SolidBucket<Solid>>(buckets_);
+		const Location location{static_cast<uint32_t>(index_of<Solid>()),
+								static_cast<uint32_t>(bucket.size())};
+		bucket.push_back(solid, id);
+		return location;
+	}
+
+	/**
+	 * \brief Copies \a solid into the bucket of its dynamic type, if it is one
+	 * of \a Solids.
+	 */
+	std::optional<Location> try_push_back(const SolidObject &solid,
+										  uint32_t id) {
+		std::optional<Location> location;
+		(
+			[&] {
+				if (!location && typeid(solid) == typeid(Solids))
+					location
+						= push_back(static_cast<const Solids &>(solid), id);
+			}(),
+			...);
+		return location;
+	}
+
+	void clear() {
+		std::apply([](auto &...bucket) { (bucket.clear(), ...); }, buckets_);
+	}
+
+	[[nodiscard]] const SolidObject &at(Location location) const {
+		gsl_Expects(location.bucket < TYPE_COUNT);
+		const SolidObject *solid = nullptr;
+		std::apply(
+			[&](const auto &...bucket) {
+				uint32_t i = 0;
+				((i++ == location.bucket ? solid = &bucket[location.index]
+										 : solid),
+				 ...);
+			},
+			buckets_);
+		return *solid;
+	}
+
+	/**
+	 * \brief Calls \a transform with the solid at \a location, then packs it
+	 * again wherever its bucket keeps a copy.
+	 */
+	template <class Transform>
+	void transform(Location location, Transform &transform) {
+		gsl_Expects(location.bucket < TYPE_COUNT);
+		std::apply(
+			[&](auto &...bucket) {
+				uint32_t i = 0;
+				((i++ == location.bucket
+					  ? bucket.transform(location.index, transform)
+					  : void()),
+				 ...);
+			},
+			buckets_);
+	}
+
+	/**
+	 * \brief Keeps the closest hit of any solid in \a closest, the work done
+	 * among the parts of a solid added to \a stats if not null.
+	 */
+	void find_closest(const Ray &ray, HitRecord &closest,
+					  TraversalStats *stats = nullptr) const {
+		std::apply(
+			[&](const auto &...bucket) {
+				(bucket.find_closest(ray, closest, stats), ...);
+			},
+			buckets_);
+	}
+
+	[[nodiscard]] bool any_hit(const Ray &ray, float t_max,
+							   TraversalStats *stats = nullptr) const {
+		return std::apply(
+			[&](const auto &...bucket) {
+				return (bucket.any_hit(ray, t_max, stats) || ...);
+			},
+			buckets_);
+	}
+
+	/**
+	 * \brief Returns the lowest id of the solids containing \a point, if any.
+	 */
+	[[nodiscard]] std::optional<uint32_t>
+	find_container(Point3fConstRef point) const {
+		std::optional<uint32_t> first;
+		std::apply(
+			[&](const auto &...bucket) {
+				(
+					[&] {
+						const auto id = bucket.find_container(point);
+						if (id && (!first || *id < *first)) first = id;
+					}(),
+					...);
+			},
+			buckets_);
+		return first;
+	}
+
+private:
+	template <class Solid> static constexpr size_t index_of() {
+		size_t i = 0;
+		((std::same_as<Solid, Solids> ? false : (++i, true)) && ...);
+		return i;
+	}
+
+	std::tuple<SolidBucket<Solids>...> buckets_;
+};
+} // namespace raytracing
+#endif /* ifndef SOLID_BUCKETS_HPP */
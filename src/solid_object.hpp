@@ -1,11 +1,14 @@
 #ifndef SOLID_OBJECT_HPP
 #define SOLID_OBJECT_HPP
 
+#include "intersection.hpp"
 #include "material.hpp"
 #include "ray.hpp"
+#include "render_stats.hpp"
 #include "transformable.hpp"
 
 #include <Eigen/Geometry>
+#include <cstdint>
 
 namespace raytracing {
 class SolidObject : public Transformable {
@@ -21,12 +24,36 @@ public:
 
 		: center_(center), optics_(optics) {}
 
+	/**
+	 * \brief Places the object coordinates in camera coordinates by \a
+	 * object_to_world, about the origin.
+	 */
+	SolidObject(const Eigen::AffineCompact3f &object_to_world,
+				const Material &optics)
+		: center_(Point3f::Zero()), model_matrix_(object_to_world),
+		  optics_(optics) {
+		update_inverse_transforms();
+	}
+
 	/**
 	 * \brief Returns the intersection at minimal distance from \a ray if
 	 * possible
 	 */
 	[[nodiscard]] virtual float hit(const Ray &ray) const = 0;
 
+	/**
+	 * \brief Returns hit(), with the index of the part hit in \a part for an
+	 * object made of several, and the work done among them added to \a stats
+	 * if not null.
+	 *
+	 * By default, the single part 0, with no work besides this call.
+	 */
+	[[nodiscard]] virtual float hit_part(const Ray &ray, uint32_t &part,
+										 TraversalStats * /*stats*/) const {
+		part = 0;
+		return hit(ray);
+	}
+
 	/**
 	 * \brief Returns true if the given point is inside this solid object.
 	 */
@@ -34,42 +61,107 @@ public:
 
 	[[nodiscard]] virtual Vector3f normal_at(Point3fConstRef point) const = 0;
 
+	/**
+	 * \brief Returns an axis-aligned box in camera coordinates enclosing
+	 * every point of this solid object.
+	 *
+	 * Acceleration structures only call hit() on the objects whose box is
+	 * crossed by the ray, so the tighter the box, the fewer calls.
+	 */
+	[[nodiscard]] virtual Eigen::AlignedBox3f bounding_box() const = 0;
+
+	/**
+	 * \brief Returns where \a ray hits this solid object at \a root, on the
+	 * part \a part, as returned by hit_part().
+	 *
+	 * By default, the normal_at() the position, with get_optics().
+	 */
+	[[nodiscard]] virtual Intersection
+	intersection_at(const Ray &ray, float root, uint32_t /*part*/) const {
+		const Point3f position = ray.at(root);
+		return {position, normal_at(position), &get_optics()};
+	}
+
 	[[nodiscard]] Ray camera_to_object_coordinates(const Ray &camera) const {
-		return {model_matrix_.inverse() * (camera.origin - center_),
-				model_matrix_.inverse().linear() * camera.direction};
+		return {world_to_object_ * (camera.origin - center_),
+				world_to_object_.linear() * camera.direction};
+	}
+
+	[[nodiscard]] Point3f
+	camera_to_object_coordinates(Point3fConstRef camera) const {
+		return world_to_object_ * (camera - center_);
+	}
+
+	[[nodiscard]] Point3f
+	object_to_camera_coordinates(Point3fConstRef object) const {
+		return model_matrix_ * object + center_;
 	}
 
 	[[nodiscard]] Ray
 	object_to_camera_coordinates(Point3fConstRef origin,
 								 Vector3fConstRef direction) const {
-		return {model_matrix_ * (origin + center_),
+		return {model_matrix_ * origin + center_,
 				model_matrix_.linear() * direction};
 	}
 
 	[[nodiscard]] Ray object_to_camera_coordinates(const Ray &object) const {
-		return {model_matrix_ * (object.origin + center_),
+		return {model_matrix_ * object.origin + center_,
 				model_matrix_.linear() * object.direction};
 	}
 
+	/**
+	 * \brief Transforms a surface normal from object to camera coordinates,
+	 * keeping it perpendicular to the surface under non-uniform scaling.
+	 */
+	[[nodiscard]] Vector3f
+	normal_to_camera_coordinates(Vector3fConstRef normal) const {
+		return (normal_matrix_ * normal).normalized();
+	}
+
+	[[nodiscard]] const Eigen::AffineCompact3f &object_to_world() const {
+		return model_matrix_;
+	}
+
+	[[nodiscard]] const Eigen::AffineCompact3f &world_to_object() const {
+		return world_to_object_;
+	}
+
+	// The inverse transpose of the linear part of object_to_world()
+	[[nodiscard]] const Eigen::Matrix3f &normal_matrix() const {
+		return normal_matrix_;
+	}
+
 	SolidObject &rotate(DegreeAnglef angle, Axis axis) final {
 		using mp_units::angular::unit_symbols::rad;
 		const auto unit_axis_vector = Vector3f::Unit(static_cast<int>(axis));
 		model_matrix_.rotate(
 			Eigen::AngleAxisf(angle.numerical_value_in(rad), unit_axis_vector));
+		update_inverse_transforms();
 		return *this;
 	}
 
 	SolidObject &translate(Vector3fConstRef displacement) final {
 		model_matrix_.translate(displacement);
+		update_inverse_transforms();
 		return *this;
 	}
 
+	/**
+	 * \brief Moves center() by the translation of the model matrix, which
+	 * keeps only the rest, so that every call moves it by the translations
+	 * since the last one.
+	 *
+	 * The object stays where object_to_camera_coordinates() puts it, e.g. an
+	 * Instance, placed by the model matrix, is not moved again.
+	 */
 	void apply() {
-		// Apply all chaining affine transformations to a Point3f object, not
-		// Vector3f
-		center_ = model_matrix_ * center_;
+		center_ += model_matrix_.translation();
+		model_matrix_.translation().setZero();
+		update_inverse_transforms();
 	}
 
+	[[nodiscard]] const Point3f &center() const { return center_; }
+
 	[[nodiscard]] Vector3f displacement_to(Vector3fConstRef point) const {
 		return point - center_;
 	}
@@ -79,10 +171,24 @@ public:
 	[[nodiscard]] Material &get_optics() { return optics_; }
 
 private:
+	/**
+	 * \brief Recomputes the matrices derived from the model matrix.
+	 *
+	 * Only a change of the model matrix calls this, so the per-ray
+	 * transformations never invert a matrix.
+	 */
+	void update_inverse_transforms() {
+		world_to_object_ = model_matrix_.inverse();
+		normal_matrix_   = world_to_object_.linear().transpose();
+	}
+
 	Point3f center_;
 
 	// The point in space about which this object rotates.
 	Eigen::AffineCompact3f model_matrix_ = Eigen::AffineCompact3f::Identity();
+	Eigen::AffineCompact3f world_to_object_
+		= Eigen::AffineCompact3f::Identity();
+	Eigen::Matrix3f normal_matrix_ = Eigen::Matrix3f::Identity();
 	Material optics_;
 };
 
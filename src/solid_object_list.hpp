@@ -1,52 +1,257 @@
 #ifndef SOLID_OBJECT_LIST_HPP
 #define SOLID_OBJECT_LIST_HPP
 
+#include "bvh.hpp"
+#include "hit_record.hpp"
+#include "instance.hpp"
 #include "intersection.hpp"
 #include "owning_container.hpp"
+#include "solid_buckets.hpp"
 #include "solid_object.hpp"
+#include "sphere.hpp"
 
 #include <algorithm>
 #include <cmath>
+#include <cstdint>
+#include <gsl/gsl-lite.hpp>
 #include <optional>
+#include <thread>
 #include <vector>
 
 namespace raytracing {
+/**
+ * \brief The solid objects of a scene.
+ *
+ * The objects of the types listed in Buckets are stored by value, one
+ * contiguous array per type, and intersected without any virtual call. Any
+ * other SolidObject is still accepted by insert() and kept behind a pointer
+ * in an OwningContainer, the slower fallback.
+ *
+ * Every object is identified by its index in the order of insertion, the
+ * only index any member takes.
+ */
+class SolidObjectList {
+public:
+	using Buckets = SolidBuckets<Sphere, Instance>;
+	using pointer = OwningContainer<SolidObject>::pointer;
 
-class SolidObjectList : public OwningContainer<SolidObject> {
-	struct RayRootInfo {
-		element_type *solid;
-		float root;
-	};
+	/**
+	 * \brief Constructs a \a Solid from \a args directly in its bucket.
+	 */
+	template <class Solid, class... Args> void emplace(Args &&...args) {
+		drop_bvh();
+		const auto id = static_cast<uint32_t>(locations_.size());
+		locations_.push_back(
+			buckets_.push_back(Solid(std::forward<Args>(args)...), id));
+	}
+
+	/**
+	 * \brief Takes ownership of \a solid, dropping the BVH built so far.
+	 *
+	 * A solid whose type has a bucket is copied into it, any other one is
+	 * kept as it is.
+	 */
+	void insert(pointer &&solid) {
+		drop_bvh();
+		const auto id = static_cast<uint32_t>(locations_.size());
+		if (const auto location = buckets_.try_push_back(*solid, id)) {
+			locations_.push_back(*location);
+			return;
+		}
+		locations_.push_back(
+			{FALLBACK, static_cast<uint32_t>(fallback_ids_.size())});
+		fallback_ids_.push_back(id);
+		fallback_.insert(std::move(solid));
+	}
+
+	void clear() {
+		drop_bvh();
+		buckets_.clear();
+		locations_.clear();
+		fallback_ids_.clear();
+		fallback_.clear();
+	}
+
+	[[nodiscard]] size_t size() const { return locations_.size(); }
+
+	// The number of objects kept behind a pointer, without a bucket
+	[[nodiscard]] size_t fallback_count() const { return fallback_ids_.size(); }
+
+	/**
+	 * \brief Calls \a transform with the object inserted \a id -th, e.g. to
+	 * rotate() or translate() it between two frames, then SolidObject::apply()
+	 * so that it moves by this call only.
+	 *
+	 * The BVH, if any, still holds the object where it was until refit_bvh().
+	 */
+	template <class Transform>
+	void transform(size_t id, Transform &&transform) {
+		const auto move = [&transform](SolidObject &solid) {
+			transform(solid);
+			solid.apply();
+		};
+		const Location location = locations_[id];
+		if (location.bucket == FALLBACK)
+			move(fallback_[location.index]);
+		else buckets_.transform(location, move);
+		if (bvh_) moved_.push_back(static_cast<uint32_t>(id));
+	}
+
+	/**
+	 * \brief Returns the object inserted \a id -th.
+	 */
+	[[nodiscard]] const SolidObject &operator[](size_t id) const {
+		const Location location = locations_[id];
+		if (location.bucket == FALLBACK)
+			return fallback_[location.index];
+		return buckets_.at(location);
+	}
+
+	/**
+	 * \brief Builds a bounding volume hierarchy over the objects with \a
+	 * builder on \a thread_count threads, laid out as \a layout, used by
+	 * every later query until the list changes.
+	 *
+	 * \note After moving objects with transform(), refit_bvh() brings it up
+	 * to date.
+	 */
+	void build_bvh(BvhBuilder builder  = BvhBuilder::BINNED_SAH,
+				   BvhLayout layout    = BvhLayout::BINARY,
+				   size_t thread_count = std::max(
+					   1U, std::thread::hardware_concurrency())) {
+		std::vector<const SolidObject *> solids;
+		solids.reserve(size());
+		for (size_t id = 0; id < size(); ++id) solids.push_back(&(*this)[id]);
+		bvh_.emplace(solids, builder, layout, thread_count);
+		moved_.clear();
+	}
+
+	/**
+	 * \brief Fits the BVH again around the objects transformed since it was
+	 * built or last refitted, on \a thread_count threads, which is much
+	 * faster than building it again while the objects only move a little.
+	 *
+	 * \return true if the tree had degraded by more than \a max_degradation
+	 * and was rebuilt instead, see Bvh::refit().
+	 */
+	bool refit_bvh(float max_degradation = Bvh::DEFAULT_MAX_DEGRADATION,
+				   size_t thread_count = std::max(
+					   1U, std::thread::hardware_concurrency())) {
+		gsl_Expects(has_bvh());
+		const bool rebuilt = bvh_->refit(moved_, max_degradation, thread_count);
+		moved_.clear();
+		return rebuilt;
+	}
+
+	[[nodiscard]] bool has_bvh() const { return bvh_.has_value(); }
+
+	[[nodiscard]] const Bvh &bvh() const {
+		gsl_Expects(has_bvh());
+		return *bvh_;
+	}
+
+	/**
+	 * \brief Returns the closest hit of any solid in the scene by \a ray
+	 *
+	 * Without a bounding volume hierarchy, every bucket is tested in a single
+	 * pass keeping the running minimum, the spheres in SIMD batches. Both ways
+	 * give the same hit and never allocate.
+	 *
+	 * \param stats If not null, receives the work done by the search.
+	 */
+	[[nodiscard]] std::optional<HitRecord>
+	find_closest_hit(const Ray &ray, TraversalStats *stats = nullptr) const {
+		HitRecord closest;
+		if (bvh_) {
+			const auto hit = bvh_->find_closest_hit(ray, stats);
+			if (hit.has_value())
+				closest = {hit->root,
+						   static_cast<uint32_t>(hit->index),
+						   hit->part};
+		} else {
+			if (stats != nullptr) stats->primitive_tests += size();
+			buckets_.find_closest(ray, closest, stats);
+			for (size_t i = 0; i < fallback_ids_.size(); ++i) {
+				uint32_t part    = 0;
+				const float root = fallback_[i].hit_part(ray, part, stats);
+				closest.keep_closest(root, fallback_ids_[i], part);
+			}
+		}
+		if (std::isinf(closest.root)) return std::nullopt;
+
+		closest.solid = &(*this)[closest.object_id];
+		return closest;
+	}
 
-public:
 	/**
 	 * \brief Returns the intersection with any solid in the scene closest
 	 * to the \a ray
 	 */
 	[[nodiscard]] std::optional<Intersection>
 	find_closest_intersection(const Ray &ray) const {
-		std::vector<RayRootInfo> list;
-		for (const auto &solid : container())
-			list.emplace_back(solid.get(), solid->hit(ray));
-		if (list.empty()) return std::nullopt;
-
-		const auto &[solid, root]
-			= std::ranges::min(list, {}, &RayRootInfo::root);
+		const auto closest = find_closest_hit(ray);
+		if (!closest.has_value()) return std::nullopt;
+		return closest->to_intersection(ray);
+	}
 
-		if (std::isinf(root)) return std::nullopt;
-		const Point3f position = ray.at(root);
-		const Vector3f normal  = solid->normal_at(position);
+	/**
+	 * \brief Returns true if any solid in the scene intersects \a ray at a
+	 * root less than \a t_max.
+	 *
+	 * Stops at the first such solid, through the bounding volume hierarchy if
+	 * there is one.
+	 *
+	 * \param stats If not null, receives the work done by the search. Without
+	 * a bounding volume hierarchy, every object counts as tested.
+	 */
+	[[nodiscard]] bool is_occluded(const Ray &ray, float t_max,
+								   TraversalStats *stats = nullptr) const {
+		if (bvh_) return bvh_->is_occluded(ray, t_max, stats);
+		if (stats != nullptr) stats->primitive_tests += size();
+		if (buckets_.any_hit(ray, t_max, stats)) return true;
+		for (size_t i = 0; i < fallback_ids_.size(); ++i) {
+			uint32_t part = 0;
+			if (fallback_[i].hit_part(ray, part, stats) < t_max) return true;
+		}
+		return false;
+	}
 
-		return std::make_optional<Intersection>(position,
-												normal,
-												&solid->get_optics());
+	/**
+	 * \brief Returns the first object inserted that contains \a point, if
+	 * any.
+	 */
+	[[nodiscard]] std::optional<const SolidObject *>
+	find_any_primary_container(Point3fConstRef point) const {
+		auto id = buckets_.find_container(point);
+		for (size_t i = 0; i < fallback_ids_.size(); ++i) {
+			if (id && *id < fallback_ids_[i]) break;
+			if (fallback_[i].contains(point)) {
+				id = fallback_ids_[i];
+				break;
+			}
+		}
+		if (!id.has_value()) return std::nullopt;
+		return &(*this)[*id];
 	}
 
-	[[nodiscard]] constexpr std::optional<element_type *>
-	find_any_primary_container(const Point3f &point) const {
-		return find_any(
-			[&point](const auto &solid) { return solid->contains(point); });
+private:
+	using Location = Buckets::Location;
+
+	void drop_bvh() {
+		bvh_.reset();
+		moved_.clear();
 	}
+
+	// The bucket of the objects kept in fallback_
+	static constexpr uint32_t FALLBACK = Buckets::TYPE_COUNT;
+
+	Buckets buckets_;
+	OwningContainer<SolidObject> fallback_; // Indexed by fallback slot
+	std::vector<Location> locations_; // Indexed by object id
+	std::vector<uint32_t> fallback_ids_;
+	std::optional<Bvh> bvh_;
+	// The ids of the objects transformed since the BVH was last fitted
+	std::vector<uint32_t> moved_;
 };
 } // namespace raytracing
 #endif /* ifndef SOLID_OBJECT_LIST_HPP */
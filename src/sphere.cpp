@@ -4,8 +4,8 @@
 #include "material.hpp"
 #include "point3f.hpp"
 #include "solid_object.hpp"
+#include "sphere_store.hpp"
 
-#include <boost/math/tools/roots.hpp>
 #include <utility>
 
 namespace raytracing {
@@ -19,20 +19,7 @@ bool Sphere::contains(Point3fConstRef point) const {
 }
 
 float Sphere::hit(const Ray &ray) const {
-	using boost::math::tools::quadratic_roots;
-
-	const auto &[orig, dir]     = ray;
-	const Vector3f displacement = displacement_to(orig);
-	const auto roots
-		= quadratic_roots(dir.squaredNorm(),
-						  2 * dir.dot(displacement),
-						  displacement.squaredNorm() - radius_ * radius_);
-
-	const Eigen::Vector2f solutions{roots.first, roots.second};
-
-	return (solutions.array() > 1e-2)
-		.select(solutions, Eigen::NumTraits<float>::infinity())
-		.minCoeff();
+	return intersect_sphere(ray, center(), radius_ * radius_);
 }
 
 Vector3f Sphere::normal_at(Point3fConstRef point) const {
@@ -41,4 +28,9 @@ Vector3f Sphere::normal_at(Point3fConstRef point) const {
 
 	return displacement_to(point).normalized();
 }
+
+Eigen::AlignedBox3f Sphere::bounding_box() const {
+	const Vector3f extent = Vector3f::Constant(radius_);
+	return {center() - extent, center() + extent};
+}
 } // namespace raytracing
@@ -9,7 +9,7 @@ class Material;
 struct Ray;
 
 // A solid_object that is more efficient than Spheroid with equal dimensions.
-class Sphere : public SolidObject {
+class Sphere final : public SolidObject {
 public:
 	Sphere(Point3fConstRef center, const Material &uniform_optics = {},
 		   float radius = 1);
@@ -24,6 +24,9 @@ public:
 	 * Solve the quadratic equation to find all possible intersection points. If
 	 * found any roots, select one with the smallest positive parametric ray
 	 * root.
+	 *
+	 * \sa intersect_sphere(), SphereStore for intersecting many spheres at
+	 * once
 	 */
 	[[nodiscard]] float hit(const Ray &ray) const override;
 
@@ -35,7 +38,9 @@ public:
 
 	[[nodiscard]] Vector3f normal_at(Point3fConstRef point) const override;
 
-	[[nodiscard]] Point3f center() const;
+	[[nodiscard]] Eigen::AlignedBox3f bounding_box() const override;
+
+	[[nodiscard]] float radius() const { return radius_; }
 
 private:
 	float radius_;
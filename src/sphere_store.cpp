@@ -0,0 +1,338 @@
+#include "sphere_store.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <gsl/gsl-lite.hpp>
+#include <limits>
+
+#if defined(__AVX2__) || defined(__AVX512F__)
+#include <immintrin.h>
+#endif
+
+namespace raytracing {
+namespace {
+constexpr float INF = std::numeric_limits<float>::infinity();
+
+// Every array is padded to a multiple of the widest batch
+constexpr size_t BATCH_ALIGNMENT = 16;
+
+#if defined(__AVX512F__)
+/*
+ * \brief The handful of 16-lane operations the kernels need, so the same
+ * kernel source compiles for every instruction set.
+ */
+struct Lanes {
+	static constexpr size_t WIDTH = 16;
+	using Float                   = __m512;
+	using Int                     = __m512i;
+	using Mask                    = __mmask16;
+
+	static Float load(const float *p) { return _mm512_load_ps(p); }
+	static Float broadcast(float x) { return _mm512_set1_ps(x); }
+	static Float add(Float a, Float b) { return _mm512_add_ps(a, b); }
+	static Float sub(Float a, Float b) { return _mm512_sub_ps(a, b); }
+	static Float mul(Float a, Float b) { return _mm512_mul_ps(a, b); }
+	static Float div(Float a, Float b) { return _mm512_div_ps(a, b); }
+	static Float sqrt(Float a) { return _mm512_sqrt_ps(a); }
+	static Float min(Float a, Float b) { return _mm512_min_ps(a, b); }
+
+	static Float negate(Float a) {
+		return _mm512_castsi512_ps(_mm512_xor_si512(_mm512_castps_si512(a),
+													_mm512_set1_epi32(SIGN)));
+	}
+
+	static Float copysign(Float magnitude, Float sign) {
+		const auto m = _mm512_castps_si512(magnitude);
+		const auto s = _mm512_castps_si512(sign);
+		return _mm512_castsi512_ps(_mm512_or_si512(
+			_mm512_andnot_si512(_mm512_set1_epi32(SIGN), m),
+			_mm512_and_si512(_mm512_set1_epi32(SIGN), s)));
+	}
+
+	static Mask greater(Float a, Float b) {
+		return _mm512_cmp_ps_mask(a, b, _CMP_GT_OQ);
+	}
+	static Mask greater_equal(Float a, Float b) {
+		return _mm512_cmp_ps_mask(a, b, _CMP_GE_OQ);
+	}
+	static Mask less(Float a, Float b) {
+		return _mm512_cmp_ps_mask(a, b, _CMP_LT_OQ);
+	}
+	static bool any(Mask m) { return m != 0; }
+
+	// mask ? a : b
+	static Float select(Mask m, Float a, Float b) {
+		return _mm512_mask_blend_ps(m, b, a);
+	}
+	static Int select(Mask m, Int a, Int b) {
+		return _mm512_mask_blend_epi32(m, b, a);
+	}
+
+	static Int iota(uint32_t first) {
+		return _mm512_add_epi32(
+			_mm512_set1_epi32(static_cast<int>(first)),
+			_mm512_setr_epi32(
+				0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15));
+	}
+	static Int broadcast_int(uint32_t x) {
+		return _mm512_set1_epi32(static_cast<int>(x));
+	}
+	static Int add(Int a, Int b) { return _mm512_add_epi32(a, b); }
+
+	static void store(float *p, Float a) { _mm512_storeu_ps(p, a); }
+	static void store(uint32_t *p, Int a) { _mm512_storeu_si512(p, a); }
+
+private:
+	static constexpr int SIGN = std::numeric_limits<int>::min();
+};
+#elif defined(__AVX2__)
+/*
+ * \brief The handful of 8-lane operations the kernels need, so the same
+ * kernel source compiles for every instruction set.
+ */
+struct Lanes {
+	static constexpr size_t WIDTH = 8;
+	using Float                   = __m256;
+	using Int                     = __m256i;
+	using Mask                    = __m256;
+
+	static Float load(const float *p) { return _mm256_load_ps(p); }
+	static Float broadcast(float x) { return _mm256_set1_ps(x); }
+	static Float add(Float a, Float b) { return _mm256_add_ps(a, b); }
+	static Float sub(Float a, Float b) { return _mm256_sub_ps(a, b); }
+	static Float mul(Float a, Float b) { return _mm256_mul_ps(a, b); }
+	static Float div(Float a, Float b) { return _mm256_div_ps(a, b); }
+	static Float sqrt(Float a) { return _mm256_sqrt_ps(a); }
+	static Float min(Float a, Float b) { return _mm256_min_ps(a, b); }
+
+	static Float negate(Float a) {
+		return _mm256_xor_ps(a, _mm256_set1_ps(-0.f));
+	}
+
+	static Float copysign(Float magnitude, Float sign) {
+		const Float sign_bit = _mm256_set1_ps(-0.f);
+		return _mm256_or_ps(_mm256_andnot_ps(sign_bit, magnitude),
+							_mm256_and_ps(sign_bit, sign));
+	}
+
+	static Mask greater(Float a, Float b) {
+		return _mm256_cmp_ps(a, b, _CMP_GT_OQ);
+	}
+	static Mask greater_equal(Float a, Float b) {
+		return _mm256_cmp_ps(a, b, _CMP_GE_OQ);
+	}
+	static Mask less(Float a, Float b) {
+		return _mm256_cmp_ps(a, b, _CMP_LT_OQ);
+	}
+	static bool any(Mask m) { return _mm256_movemask_ps(m) != 0; }
+
+	// mask ? a : b
+	static Float select(Mask m, Float a, Float b) {
+		return _mm256_blendv_ps(b, a, m);
+	}
+	static Int select(Mask m, Int a, Int b) {
+		return _mm256_blendv_epi8(b, a, _mm256_castps_si256(m));
+	}
+
+	static Int iota(uint32_t first) {
+		return _mm256_add_epi32(_mm256_set1_epi32(static_cast<int>(first)),
+								_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+	}
+	static Int broadcast_int(uint32_t x) {
+		return _mm256_set1_epi32(static_cast<int>(x));
+	}
+	static Int add(Int a, Int b) { return _mm256_add_epi32(a, b); }
+
+	static void store(float *p, Float a) { _mm256_storeu_ps(p, a); }
+	static void store(uint32_t *p, Int a) {
+		_mm256_storeu_si256(reinterpret_cast<__m256i *>(p), a);
+	}
+};
+#endif
+
+#if defined(__AVX2__) || defined(__AVX512F__)
+/*
+ * \brief Intersects a ray with Lanes::WIDTH spheres at once, every lane
+ * computing exactly what intersect_sphere() does.
+ */
+struct BatchKernel {
+	Lanes::Float ox, oy, oz, dx, dy, dz, a;
+
+	explicit BatchKernel(const Ray &ray)
+		: ox(Lanes::broadcast(ray.origin.x())),
+		  oy(Lanes::broadcast(ray.origin.y())),
+		  oz(Lanes::broadcast(ray.origin.z())),
+		  dx(Lanes::broadcast(ray.direction.x())),
+		  dy(Lanes::broadcast(ray.direction.y())),
+		  dz(Lanes::broadcast(ray.direction.z())),
+		  a(Lanes::broadcast(ray.direction.x() * ray.direction.x()
+							 + ray.direction.y() * ray.direction.y()
+							 + ray.direction.z() * ray.direction.z())) {}
+
+	[[nodiscard]] Lanes::Float roots(const float *cx, const float *cy,
+									 const float *cz,
+									 const float *radius2) const {
+		using L       = Lanes;
+		const auto px = L::sub(ox, L::load(cx));
+		const auto py = L::sub(oy, L::load(cy));
+		const auto pz = L::sub(oz, L::load(cz));
+
+		const auto h
+			= L::add(L::add(L::mul(dx, px), L::mul(dy, py)), L::mul(dz, pz));
+		const auto c
+			= L::sub(L::add(L::add(L::mul(px, px), L::mul(py, py)),
+							L::mul(pz, pz)),
+					 L::load(radius2));
+		const auto discriminant = L::sub(L::mul(h, h), L::mul(a, c));
+
+		const auto q
+			= L::negate(L::add(h, L::copysign(L::sqrt(discriminant), h)));
+		const auto x0 = L::div(q, a);
+		const auto x1 = L::div(c, q);
+
+		const auto inf      = L::broadcast(INF);
+		const auto min_root = L::broadcast(MIN_ROOT);
+		const auto t0       = L::select(L::greater(x0, min_root), x0, inf);
+		const auto t1       = L::select(L::greater(x1, min_root), x1, inf);
+
+		// Branchless miss: a negative or NaN (padding) discriminant
+		return L::select(L::greater_equal(discriminant, L::broadcast(0.f)),
+						 L::min(t0, t1),
+						 inf);
+	}
+};
+#endif
+} // namespace
+
+float intersect_sphere(const Ray &ray, Point3fConstRef center,
+					   float radius2) {
+	const auto &[origin, dir] = ray;
+	const float px            = origin.x() - center.x();
+	const float py            = origin.y() - center.y();
+	const float pz            = origin.z() - center.z();
+
+	const float a = dir.x() * dir.x() + dir.y() * dir.y() + dir.z() * dir.z();
+	const float h = dir.x() * px + dir.y() * py + dir.z() * pz;
+	const float c = px * px + py * py + pz * pz - radius2;
+	const float discriminant = h * h - a * c;
+	if (!(discriminant >= 0.f)) return INF;
+
+	const float q  = -(h + std::copysign(std::sqrt(discriminant), h));
+	const float x0 = q / a;
+	const float x1 = c / q;
+
+	const float t0 = x0 > MIN_ROOT ? x0 : INF;
+	const float t1 = x1 > MIN_ROOT ? x1 : INF;
+	return std::min(t0, t1);
+}
+
+void SphereStore::push_back(Point3fConstRef center, float radius,
+							uint32_t id) {
+	if (size_ == ids_.size()) {
+		const size_t padded = size_ + BATCH_ALIGNMENT;
+		const float nan     = std::numeric_limits<float>::quiet_NaN();
+		for (auto *array : {&center_x_, &center_y_, &center_z_, &radius2_})
+			array->resize(padded, nan);
+		ids_.resize(padded, std::numeric_limits<uint32_t>::max());
+	}
+
+	center_x_[size_] = center.x();
+	center_y_[size_] = center.y();
+	center_z_[size_] = center.z();
+	radius2_[size_]  = radius * radius;
+	ids_[size_]      = id;
+	++size_;
+}
+
+void SphereStore::set(size_t i, Point3fConstRef center, float radius) {
+	gsl_Expects(i < size_);
+	center_x_[i] = center.x();
+	center_y_[i] = center.y();
+	center_z_[i] = center.z();
+	radius2_[i]  = radius * radius;
+}
+
+void SphereStore::clear() {
+	for (auto *array : {&center_x_, &center_y_, &center_z_, &radius2_})
+		array->clear();
+	ids_.clear();
+	size_ = 0;
+}
+
+SphereStore::Hit SphereStore::find_closest(const Ray &ray) const {
+#if defined(__AVX2__) || defined(__AVX512F__)
+	using L = Lanes;
+	const BatchKernel kernel{ray};
+
+	// Every lane keeps its own closest root, strictly less keeping the first
+	// index of the lane on ties.
+	auto closest       = L::broadcast(INF);
+	auto closest_index = L::broadcast_int(0);
+	auto index         = L::iota(0);
+	const auto step    = L::broadcast_int(L::WIDTH);
+
+	for (size_t i = 0; i < size_; i += L::WIDTH) {
+		const auto roots  = kernel.roots(&center_x_[i],
+										 &center_y_[i],
+										 &center_z_[i],
+										 &radius2_[i]);
+		const auto closer = L::less(roots, closest);
+		closest           = L::select(closer, roots, closest);
+		closest_index     = L::select(closer, index, closest_index);
+		index             = L::add(index, step);
+	}
+
+	std::array<float, L::WIDTH> lane_roots{};
+	std::array<uint32_t, L::WIDTH> lane_indexes{};
+	L::store(lane_roots.data(), closest);
+	L::store(lane_indexes.data(), closest_index);
+
+	Hit hit{INF, 0};
+	size_t hit_index = 0;
+	for (size_t lane = 0; lane < L::WIDTH; ++lane)
+		if (lane_roots[lane] < hit.root
+			|| (lane_roots[lane] == hit.root
+				&& lane_indexes[lane] < hit_index)) {
+			hit.root  = lane_roots[lane];
+			hit_index = lane_indexes[lane];
+		}
+#else
+	Hit hit{INF, 0};
+	size_t hit_index = 0;
+	for (size_t i = 0; i < size_; ++i) {
+		const Point3f center{center_x_[i], center_y_[i], center_z_[i]};
+		if (const float root = intersect_sphere(ray, center, radius2_[i]);
+			root < hit.root) {
+			hit.root  = root;
+			hit_index = i;
+		}
+	}
+#endif
+	if (!std::isinf(hit.root)) hit.id = ids_[hit_index];
+	return hit;
+}
+
+bool SphereStore::any_hit(const Ray &ray, float t_max) const {
+#if defined(__AVX2__) || defined(__AVX512F__)
+	using L = Lanes;
+	const BatchKernel kernel{ray};
+	const auto limit = L::broadcast(t_max);
+
+	for (size_t i = 0; i < size_; i += L::WIDTH)
+		if (L::any(L::less(kernel.roots(&center_x_[i],
+										&center_y_[i],
+										&center_z_[i],
+										&radius2_[i]),
+						   limit)))
+			return true;
+	return false;
+#else
+	for (size_t i = 0; i < size_; ++i) {
+		const Point3f center{center_x_[i], center_y_[i], center_z_[i]};
+		if (intersect_sphere(ray, center, radius2_[i]) < t_max) return true;
+	}
+	return false;
+#endif
+}
+} // namespace raytracing
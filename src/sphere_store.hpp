@@ -0,0 +1,80 @@
+#ifndef SPHERE_STORE_HPP
+#define SPHERE_STORE_HPP
+
+#include "aligned_allocator.hpp"
+#include "point3f.hpp"
+#include "ray.hpp"
+
+#include <cstdint>
+
+namespace raytracing {
+/*
+ * \brief Roots closer than this to the origin of a ray are taken to be the
+ * surface the ray starts from, not another intersection.
+ */
+inline constexpr float MIN_ROOT = 1e-2f;
+
+/**
+ * \brief Returns the smallest root greater than MIN_ROOT at which \a ray
+ * crosses the sphere, or infinity if there is none.
+ *
+ * Uses the numerically stable form of the quadratic formula, with the half
+ * linear coefficient h = direction.(origin - center):
+ * \f[ q = -(h + sign(h)\sqrt{h^2 - ac}), \quad x_0 = q/a, \quad x_1 = c/q \f]
+ *
+ * \note The SphereStore kernels perform exactly the same sequence of IEEE
+ * operations on every lane, so both give bit-identical roots.
+ */
+[[nodiscard]] float intersect_sphere(const Ray &ray, Point3fConstRef center,
+									 float radius2);
+
+/**
+ * \brief A structure-of-arrays store of spheres, intersected with a ray 8
+ * (AVX2) or 16 (AVX-512) spheres at a time.
+ *
+ * The center coordinates, squared radii and ids live in separate 64-byte
+ * aligned arrays, padded with NaN spheres that never hit up to a multiple of
+ * 16, so the kernels only issue full aligned loads. Without AVX2, a scalar
+ * loop over intersect_sphere() is used.
+ */
+class SphereStore {
+public:
+	struct Hit {
+		float root; // Infinity if no sphere is hit
+		uint32_t id;
+	};
+
+	/**
+	 * \param id Returned by the queries to identify the sphere, e.g. the
+	 * index of its object or of its material.
+	 */
+	void push_back(Point3fConstRef center, float radius, uint32_t id);
+
+	// Moves the sphere pushed \a i -th, keeping its id
+	void set(size_t i, Point3fConstRef center, float radius);
+
+	void clear();
+
+	[[nodiscard]] size_t size() const { return size_; }
+
+	[[nodiscard]] bool empty() const { return size_ == 0; }
+
+	/**
+	 * \brief Returns the closest sphere hit by \a ray, the first one pushed
+	 * winning ties.
+	 */
+	[[nodiscard]] Hit find_closest(const Ray &ray) const;
+
+	/**
+	 * \brief Returns true if any sphere is hit by \a ray at a root less than
+	 * \a t_max, stopping at the first batch containing one.
+	 */
+	[[nodiscard]] bool any_hit(const Ray &ray, float t_max) const;
+
+private:
+	AlignedVector<float> center_x_, center_y_, center_z_, radius2_;
+	AlignedVector<uint32_t> ids_;
+	size_t size_ = 0;
+};
+} // namespace raytracing
+#endif /* ifndef SPHERE_STORE_HPP */
@@ -0,0 +1,114 @@
+#include "thread_pool.hpp"
+
+#include <gsl/gsl-lite.hpp>
+#include <utility>
+
+namespace raytracing {
+ThreadPool::ThreadPool(size_t thread_count) : queues_(thread_count) {
+	gsl_Expects(thread_count > 0);
+
+	// The calling thread works as the first worker
+	workers_.reserve(thread_count - 1);
+	for (size_t worker = 1; worker < thread_count; ++worker)
+		workers_.emplace_back([this, worker](const std::stop_token &stop) {
+			run_worker(stop, worker);
+		});
+}
+
+ThreadPool::~ThreadPool() {
+	for (auto &worker : workers_) worker.request_stop();
+	wake_.notify_all();
+}
+
+void ThreadPool::parallel_for(size_t task_count,
+							  const std::function<void(size_t)> &task) {
+	if (task_count == 0) return;
+
+	{
+		const std::scoped_lock lock(mutex_);
+		task_    = &task;
+		pending_ = task_count;
+	}
+
+	// Hand out contiguous runs of indexes, neighbouring tiles tend to cost
+	// about the same.
+	const size_t share = (task_count + size() - 1) / size();
+	for (size_t worker = 0; worker < size(); ++worker) {
+		const size_t last = std::min(task_count, (worker + 1) * share);
+		const std::scoped_lock lock(queues_[worker].mutex);
+		for (size_t i = worker * share; i < last; ++i)
+			queues_[worker].tasks.push_back(i);
+	}
+
+	{
+		const std::scoped_lock lock(mutex_);
+		++generation_;
+	}
+	wake_.notify_all();
+
+	drain(0);
+
+	std::unique_lock lock(mutex_);
+	finished_.wait(lock, [this] { return pending_ == 0; });
+	task_                          = nullptr;
+	failed_                        = false;
+	const std::exception_ptr error = std::exchange(error_, nullptr);
+	lock.unlock();
+	if (error) std::rethrow_exception(error);
+}
+
+void ThreadPool::run_worker(const std::stop_token &stop, size_t worker) {
+	size_t seen = 0;
+	while (true) {
+		{
+			std::unique_lock lock(mutex_);
+			if (!wake_.wait(lock, stop, [&] { return generation_ != seen; }))
+				return;
+			seen = generation_;
+		}
+		drain(worker);
+	}
+}
+
+void ThreadPool::drain(size_t worker) {
+	size_t task = 0;
+	while (try_pop(worker, task)) {
+		// An exception must not escape a worker, nor leave the others
+		// running the task after parallel_for() returned
+		try {
+			if (!failed_) (*task_)(task);
+		} catch (...) {
+			const std::scoped_lock lock(mutex_);
+			if (!error_) error_ = std::current_exception();
+			failed_ = true;
+		}
+		if (--pending_ == 0) {
+			const std::scoped_lock lock(mutex_);
+			finished_.notify_all();
+		}
+	}
+}
+
+bool ThreadPool::try_pop(size_t worker, size_t &task) {
+	{
+		auto &own = queues_[worker];
+		const std::scoped_lock lock(own.mutex);
+		if (!own.tasks.empty()) {
+			task = own.tasks.back();
+			own.tasks.pop_back();
+			return true;
+		}
+	}
+
+	for (size_t offset = 1; offset < size(); ++offset) {
+		auto &victim = queues_[(worker + offset) % size()];
+		const std::scoped_lock lock(victim.mutex);
+		if (!victim.tasks.empty()) {
+			task = victim.tasks.front();
+			victim.tasks.pop_front();
+			return true;
+		}
+	}
+	return false;
+}
+} // namespace raytracing
@@ -0,0 +1,87 @@
+#ifndef THREAD_POOL_HPP
+#define THREAD_POOL_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <stop_token>
+#include <thread>
+#include <vector>
+
+namespace raytracing {
+/**
+ * \brief A fixed set of worker threads executing indexed tasks with work
+ * stealing.
+ *
+ * Every worker owns a queue of task indexes. It pops from the back of its own
+ * queue and, once that runs dry, steals from the front of the others, so
+ * uneven tasks (e.g. tiles covering a glass sphere next to empty sky) still
+ * keep every thread busy until the very end.
+ */
+class ThreadPool {
+public:
+	/**
+	 * \param thread_count The total number of threads, including the one
+	 * calling parallel_for(). 1 runs every task on the calling thread.
+	 */
+	explicit ThreadPool(size_t thread_count
+						= std::max(1U, std::thread::hardware_concurrency()));
+
+	ThreadPool(const ThreadPool &)            = delete;
+	ThreadPool(ThreadPool &&)                 = delete;
+	ThreadPool &operator=(const ThreadPool &) = delete;
+	ThreadPool &operator=(ThreadPool &&)      = delete;
+	~ThreadPool();
+
+	[[nodiscard]] size_t size() const { return queues_.size(); }
+
+	/**
+	 * \brief Calls \a task with every index in [0, task_count) and blocks
+	 * until all of them returned.
+	 *
+	 * Once a task throws, the tasks not started yet are skipped, and the
+	 * first exception thrown is rethrown on the calling thread after every
+	 * task running returned.
+	 *
+	 * \warning \a task is called concurrently, it must not write to any state
+	 * shared between indexes.
+	 */
+	void parallel_for(size_t task_count,
+					  const std::function<void(size_t)> &task);
+
+private:
+	struct WorkQueue {
+		std::mutex mutex;
+		std::deque<size_t> tasks;
+	};
+
+	void run_worker(const std::stop_token &stop, size_t worker);
+
+	// Executes tasks until there is nothing left to pop or steal.
+	void drain(size_t worker);
+
+	bool try_pop(size_t worker, size_t &task);
+
+	std::vector<WorkQueue> queues_;
+	const std::function<void(size_t)> *task_ = nullptr;
+	std::atomic<size_t> pending_             = 0;
+	// The first exception a task of the current call threw, if any
+	std::exception_ptr error_;
+	std::atomic<bool> failed_ = false;
+
+	std::mutex mutex_;
+	std::condition_variable_any wake_;
+	std::condition_variable finished_;
+	size_t generation_ = 0;
+
+	// Declared last so that the workers are joined before anything they use
+	// is destroyed.
+	std::vector<std::jthread> workers_;
+};
+} // namespace raytracing
+#endif /* ifndef THREAD_POOL_HPP */
@@ -0,0 +1,40 @@
+#ifndef TILE_HPP
+#define TILE_HPP
+
+#include "rect.hpp"
+
+#include <algorithm>
+#include <vector>
+
+namespace raytracing {
+/**
+ * \brief A rectangular block of pixels of an image, the unit of work handed
+ * out to the rendering threads.
+ */
+struct Tile {
+	size_t x, y;
+	size_t width, height;
+
+	[[nodiscard]] constexpr size_t area() const { return width * height; }
+};
+
+/**
+ * \brief Splits \a image into square tiles of \a tile_size pixels per side in
+ * row-major order.
+ *
+ * The tiles on the right and bottom borders are clipped to the image, so every
+ * pixel belongs to exactly one tile.
+ */
+[[nodiscard]] inline std::vector<Tile> split_into_tiles(Rect image,
+														size_t tile_size) {
+	std::vector<Tile> tiles;
+	for (size_t y = 0; y < image.height; y += tile_size)
+		for (size_t x = 0; x < image.width; x += tile_size)
+			tiles.push_back({x,
+							 y,
+							 std::min(tile_size, image.width - x),
+							 std::min(tile_size, image.height - y)});
+	return tiles;
+}
+} // namespace raytracing
+#endif /* ifndef TILE_HPP */
@@ -0,0 +1,64 @@
+#include "framebuffer.hpp"
+#include "image_encoder.hpp"
+
+#include <catch2/catch_test_macros.hpp>
+#include <cstdint>
+#include <filesystem>
+#include <lodepng.h>
+#include <string>
+#include <vector>
+
+namespace raytracing {
+namespace {
+std::vector<uint8_t> decode(const std::string &filename, Rect dimension) {
+	std::vector<uint8_t> rgb;
+	unsigned width = 0, height = 0;
+	REQUIRE(lodepng::decode(rgb, width, height, filename, LCT_RGB) == 0);
+	REQUIRE((width == dimension.width && height == dimension.height));
+	return rgb;
+}
+} // namespace
+
+SCENARIO("A .png stream decodes to the same pixels however it is written",
+		 "[image_encoder][png]") {
+	GIVEN("A noisy gradient image") {
+		const Rect dimension{37, 70};
+		Framebuffer image{dimension};
+		for (size_t j = 0; j < dimension.height; ++j)
+			for (size_t i = 0; i < dimension.width; ++i)
+				image.at(i, j) = ScaledColor(0.03f * i,
+											 float(i * j % 17) / 17.f,
+											 0.02f * j);
+
+		std::vector<uint8_t> expected;
+		for (const auto &color : image.pixels()) {
+			const auto final = to_rgb(color, 2.2f);
+			expected.insert(expected.end(), final.begin(), final.end());
+		}
+		const auto dir = std::filesystem::temp_directory_path();
+
+		WHEN("It is written by write_png()") {
+			const auto filename = (dir / "encode_test.png").string();
+			write_png(filename, image, 2.2f);
+
+			THEN("LodePNG decodes every byte back") {
+				REQUIRE(decode(filename, dimension) == expected);
+			}
+		}
+
+		WHEN("Its bands are written last to first, the last one shorter") {
+			const auto filename = (dir / "encode_test_bands.png").string();
+			{
+				PngStream png{filename, dimension, 9, 2.2f};
+				REQUIRE(png.band_count() == 8);
+				for (size_t band = png.band_count(); band-- > 0;)
+					png.write_band(image, band);
+			}
+
+			THEN("LodePNG decodes every byte back") {
+				REQUIRE(decode(filename, dimension) == expected);
+			}
+		}
+	}
+}
+} // namespace raytracing
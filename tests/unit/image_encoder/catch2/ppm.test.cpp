@@ -0,0 +1,50 @@
+#include "framebuffer.hpp"
+#include "image_encoder.hpp"
+
+#include <catch2/catch_test_macros.hpp>
+#include <filesystem>
+#include <fstream>
+#include <string>
+
+namespace raytracing {
+SCENARIO("The binary and ASCII .ppm formats store the same pixels",
+		 "[image_encoder][ppm]") {
+	GIVEN("A small gradient image") {
+		Framebuffer image{Rect{5, 3}};
+		for (size_t j = 0; j < 3; ++j)
+			for (size_t i = 0; i < 5; ++i)
+				image.at(i, j) = ScaledColor(0.2f * i, 0.4f * j, 1.5f);
+
+		const auto dir   = std::filesystem::temp_directory_path();
+		const auto ascii = (dir / "encode_test_p3.ppm").string();
+		const auto bin   = (dir / "encode_test_p6.ppm").string();
+
+		WHEN("It is written in both formats") {
+			write_ppm(ascii, image, 2.2f, PpmFormat::ASCII);
+			write_ppm(bin, image, 2.2f, PpmFormat::BINARY);
+
+			THEN("Every decimal component of P3 matches the byte of P6") {
+				std::ifstream p3{ascii};
+				std::ifstream p6{bin, std::ios::binary};
+				std::string magic;
+				size_t width = 0, height = 0, max = 0;
+
+				p3 >> magic >> width >> height >> max;
+				REQUIRE(magic == "P3");
+				p6 >> magic >> width >> height >> max;
+				REQUIRE(magic == "P6");
+				REQUIRE((width == 5 && height == 3 && max == 255));
+				p6.get();
+
+				for (size_t k = 0; k < 3 * image.dimension().area(); ++k) {
+					int decimal = 0;
+					p3 >> decimal;
+					const auto byte = static_cast<uint8_t>(p6.get());
+					REQUIRE(decimal == byte);
+				}
+				REQUIRE(p6.peek() == std::char_traits<char>::eof());
+			}
+		}
+	}
+}
+} // namespace raytracing
@@ -0,0 +1,199 @@
+#include "framebuffer.hpp"
+#include "image_renderer.hpp"
+#include "material.hpp"
+#include "render_stats.hpp"
+#include "scenes.hpp"
+#include "sphere.hpp"
+
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/generators/catch_generators.hpp>
+#include <cmath>
+#include <memory>
+
+namespace raytracing {
+namespace {
+// How many pixels differ from the pixel at the same position in the aliased
+// image
+size_t count_blended(const Framebuffer &image, const Framebuffer &aliased) {
+	size_t blended = 0;
+	for (size_t j = 0; j < image.dimension().height; ++j)
+		for (size_t i = 0; i < image.dimension().width; ++i)
+			if (image.at(i, j) != aliased.at(i, j)) ++blended;
+	return blended;
+}
+} // namespace
+
+SCENARIO("Several samples per pixel smooth the edges of the objects",
+		 "[image_renderer][render][antialiasing]") {
+	GIVEN("A matte sphere against the background") {
+		auto [dimension, vp, r] = test::make_empty_scene(Rect{48, 36});
+		// Black, so every sample is either black or the white background
+		r.add(std::make_unique<Sphere>(
+			Point3f{0, 1, 0},
+			Material{ScaledColor::Zero(), 1, 0, 1.5},
+			1.0));
+		const Framebuffer aliased = r.render(vp, dimension);
+
+		WHEN("A single sample is traced per pixel") {
+			r.set_samples_per_pixel(1);
+			r.set_pixel_filter(PixelFilter::TENT);
+
+			THEN("It goes through the pixel center as before") {
+				REQUIRE(r.render(vp, dimension) == aliased);
+			}
+		}
+
+		WHEN("16 samples are traced per pixel with a box filter") {
+			r.set_samples_per_pixel(16);
+			r.set_tile_size(8);
+			const Framebuffer image = r.render(vp, dimension);
+
+			THEN("The pixels on the edge are shades of gray") {
+				size_t gray = 0;
+				for (const ScaledColor &color : image.pixels()) {
+					REQUIRE(color.minCoeff() >= 0.f);
+					REQUIRE(color.maxCoeff() <= 1.f + 1e-6f);
+					if (color.x() > 0.f && color.x() < 1.f) ++gray;
+				}
+				REQUIRE(gray > 0);
+				REQUIRE(count_blended(image, aliased) >= gray);
+			}
+
+			THEN("The pixels far from the edge keep their color") {
+				REQUIRE(image.at(0, 0).isApprox(aliased.at(0, 0)));
+				REQUIRE(image.at(24, 18).isApprox(aliased.at(24, 18)));
+			}
+
+			THEN("The image does not depend on how it is split") {
+				r.set_tile_size(5);
+				r.set_thread_count(3);
+				REQUIRE(r.render(vp, dimension) == image);
+			}
+		}
+
+		WHEN("The samples are drawn from a tent filter instead") {
+			r.set_samples_per_pixel(9);
+			const Framebuffer box = r.render(vp, dimension);
+			r.set_pixel_filter(PixelFilter::TENT);
+			const Framebuffer tent = r.render(vp, dimension);
+
+			THEN("The samples reach into the neighbours, blurring more") {
+				REQUIRE(count_blended(tent, aliased)
+						>= count_blended(box, aliased));
+			}
+		}
+	}
+}
+
+SCENARIO("The samples of a pixel are centered on it however many they are",
+		 "[image_renderer][render][antialiasing]") {
+	GIVEN("A tiny pixel centered on the straight edge of a black sphere") {
+		const uint32_t samples = GENERATE(3U, 5U, 6U, 7U, 13U, 16U);
+		const auto filter = GENERATE(PixelFilter::BOX, PixelFilter::TENT);
+		// On the top of the sphere or on its right side
+		const Point3f center = GENERATE(Point3f{0, test::EDGE, -1},
+										Point3f{test::EDGE, 0, -1});
+
+		test::Scene scene  = test::make_edge_scene(center);
+		const Viewport &vp = scene.viewport;
+		ImageRenderer &r   = scene.renderer;
+		r.set_samples_per_pixel(samples);
+		r.set_pixel_filter(filter);
+
+		// The share of the samples missing the sphere, over many seeds
+		const auto coverage = [&] {
+			constexpr int SEED_COUNT = 256;
+			float sum                = 0.f;
+			for (int seed = 0; seed < SEED_COUNT; ++seed) {
+				r.set_seed(seed);
+				sum += r.render(vp, scene.dimension).at(0, 0).x();
+			}
+			return sum / SEED_COUNT;
+		};
+
+		WHEN("It is rendered with many seeds") {
+			const float share = coverage();
+
+			THEN("Half of the samples miss the sphere on average") {
+				CAPTURE(samples, filter, center, share);
+				REQUIRE(std::abs(share - 0.5f) < 0.04f);
+			}
+		}
+
+		WHEN("Adaptive sampling is on, but the edge never converges") {
+			r.set_adaptive_sampling(1e-6f, 2);
+			const float share = coverage();
+
+			THEN("The scrambled strata are just as centered") {
+				CAPTURE(samples, filter, center, share);
+				REQUIRE(std::abs(share - 0.5f) < 0.04f);
+			}
+		}
+	}
+}
+
+SCENARIO("A prime number of samples is stratified both ways",
+		 "[image_renderer][render][antialiasing]") {
+	GIVEN("A tiny pixel centered on the straight edge of a black sphere") {
+		const uint32_t samples = GENERATE(7U, 13U);
+		// A horizontal edge, then a vertical one
+		const Point3f center = GENERATE(Point3f{0, test::EDGE, -1},
+										Point3f{test::EDGE, 0, -1});
+		auto [dimension, vp, r] = test::make_edge_scene(center);
+		r.set_samples_per_pixel(samples);
+
+		THEN("Every seed puts as many samples on either side, give or take "
+			 "the one or two sharing a stratum with the edge") {
+			for (int seed = 0; seed < 64; ++seed) {
+				r.set_seed(seed);
+				const float share = r.render(vp, dimension).at(0, 0).x();
+				CAPTURE(samples, center, seed, share);
+				REQUIRE(std::abs(share - 0.5f)
+						<= 1.5f / static_cast<float>(samples) + 1e-3f);
+			}
+		}
+	}
+}
+
+SCENARIO("Adaptive sampling spends the samples where the image is noisy",
+		 "[image_renderer][render][antialiasing][adaptive]") {
+	GIVEN("A lit glass sphere on a ground sphere, 16 samples per pixel") {
+		auto [dimension, vp, r] = test::make_glass_scene(Rect{48, 36});
+		r.set_samples_per_pixel(16);
+
+		RenderStats uniform_stats;
+		const Framebuffer uniform = r.render(vp, dimension, &uniform_stats);
+
+		WHEN("The pixels stop at a standard error of 0.01") {
+			r.set_adaptive_sampling(0.01f);
+			RenderStats stats;
+			const Framebuffer image = r.render(vp, dimension, &stats);
+
+			THEN("Far fewer rays are traced") {
+				REQUIRE(uniform_stats.primary_rays == 16 * dimension.area());
+				REQUIRE(stats.primary_rays >= 4 * dimension.area());
+				REQUIRE(stats.primary_rays * 2 < uniform_stats.primary_rays);
+			}
+
+			THEN("The image is about as close to the uniform one") {
+				float error = 0.f;
+				for (size_t p = 0; p < image.pixels().size(); ++p)
+					error += (image.pixels()[p] - uniform.pixels()[p])
+								 .cwiseAbs()
+								 .maxCoeff();
+				REQUIRE(error / static_cast<float>(dimension.area()) < 0.01f);
+			}
+
+			THEN("The background converged after the fewest samples") {
+				REQUIRE(image.at(0, 0) == ScaledColor::Ones());
+			}
+
+			THEN("The image does not depend on how it is split") {
+				r.set_tile_size(5);
+				r.set_thread_count(3);
+				REQUIRE(r.render(vp, dimension) == image);
+			}
+		}
+	}
+}
+} // namespace raytracing
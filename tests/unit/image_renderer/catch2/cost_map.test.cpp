@@ -0,0 +1,61 @@
+#include "cost_map.hpp"
+#include "image_renderer.hpp"
+#include "render_stats.hpp"
+#include "scenes.hpp"
+
+#include <catch2/catch_test_macros.hpp>
+#include <numeric>
+
+namespace raytracing {
+SCENARIO("The cost map charges every test to its pixel",
+		 "[image_renderer][cost_map]") {
+	GIVEN("A lit scene of a ground sphere and a glass sphere") {
+		auto [dimension, vp, r] = test::make_glass_scene(Rect{40, 30});
+		r.set_tile_size(16);
+		r.build_bvh();
+
+		WHEN("The intersection tests of every pixel are recorded") {
+			CostMap cost{dimension, CostMetric::INTERSECTION_TESTS};
+			RenderStats stats;
+			const Framebuffer image = r.render(vp, dimension, cost, &stats);
+
+			THEN("The image is the same as without the cost map") {
+				REQUIRE(image == r.render(vp, dimension));
+			}
+
+			THEN("The costs add up to the tests of the whole render") {
+				const double total = std::accumulate(cost.costs().begin(),
+													 cost.costs().end(),
+													 0.0);
+				REQUIRE(total
+						== static_cast<double>(stats.primitive_tests
+											   + stats.bvh_node_visits));
+			}
+
+			THEN("The false colors go from black to white") {
+				const Framebuffer heatmap = to_false_color(cost);
+				REQUIRE(heatmap.dimension() == dimension);
+				for (size_t j = 0; j < dimension.height; ++j)
+					for (size_t i = 0; i < dimension.width; ++i) {
+						const ScaledColor &color = heatmap.at(i, j);
+						REQUIRE(color.minCoeff() >= 0.f);
+						REQUIRE(color.maxCoeff() <= 1.f);
+						if (cost.at(i, j) == cost.max())
+							REQUIRE(color == ScaledColor::Ones());
+					}
+			}
+		}
+
+		WHEN("Every pixel is timed") {
+			CostMap cost{dimension, CostMetric::TIME};
+			const Framebuffer image = r.render(vp, dimension, cost);
+
+			THEN("The image is the same, every pixel took some time") {
+				REQUIRE(image == r.render(vp, dimension));
+				REQUIRE(std::ranges::all_of(cost.costs(),
+											[](float t) { return t > 0.f; }));
+			}
+		}
+	}
+}
+} // namespace raytracing
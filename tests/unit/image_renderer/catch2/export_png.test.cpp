@@ -0,0 +1,51 @@
+#include "framebuffer.hpp"
+#include "image_renderer.hpp"
+#include "scenes.hpp"
+
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/generators/catch_generators.hpp>
+#include <cstdint>
+#include <filesystem>
+#include <lodepng.h>
+#include <string>
+#include <vector>
+
+namespace raytracing {
+SCENARIO("export_png() writes the image render() returns",
+		 "[image_renderer][render][png]") {
+	GIVEN("A scene whose sides are no multiple of the tile size") {
+		auto [dimension, vp, r] = test::make_glass_scene(Rect{45, 37});
+
+		// Every row of tiles is a band of the stream, the last one shorter
+		const size_t tile_size    = GENERATE(8U, 16U, 64U);
+		const size_t thread_count = GENERATE(1U, 3U);
+		r.set_tile_size(tile_size);
+		r.set_thread_count(thread_count);
+
+		const Framebuffer image = r.render(vp, dimension);
+		std::vector<uint8_t> expected;
+		for (const auto &color : image.pixels()) {
+			const auto final = to_rgb(color, 2.2f);
+			expected.insert(expected.end(), final.begin(), final.end());
+		}
+
+		WHEN("It is exported while it renders") {
+			const auto filename = (std::filesystem::temp_directory_path()
+								   / "export_png_test.png")
+									  .string();
+			r.export_png(filename, vp, dimension, 2.2f);
+
+			THEN("LodePNG decodes every pixel back") {
+				std::vector<uint8_t> rgb;
+				unsigned width = 0, height = 0;
+				CAPTURE(tile_size, thread_count);
+				REQUIRE(lodepng::decode(rgb, width, height, filename, LCT_RGB)
+						== 0);
+				REQUIRE(width == dimension.width);
+				REQUIRE(height == dimension.height);
+				REQUIRE(rgb == expected);
+			}
+		}
+	}
+}
+} // namespace raytracing
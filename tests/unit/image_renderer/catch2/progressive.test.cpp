@@ -0,0 +1,185 @@
+#include "framebuffer.hpp"
+#include "image_renderer.hpp"
+#include "render_stats.hpp"
+#include "sample_buffer.hpp"
+#include "scenes.hpp"
+
+#include <algorithm>
+#include <catch2/catch_test_macros.hpp>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <filesystem>
+#include <stdexcept>
+#include <vector>
+
+namespace raytracing {
+SCENARIO("A time budget renders a complete image, refined in passes",
+		 "[image_renderer][render][progressive]") {
+	using namespace std::chrono_literals;
+
+	GIVEN("A lit glass sphere on a ground sphere") {
+		auto [dimension, vp, r] = test::make_glass_scene(Rect{36, 27});
+		r.set_tile_size(8);
+		const Framebuffer reference = r.render(vp, dimension);
+
+		WHEN("There is no time at all") {
+			RenderStats stats;
+			const Framebuffer image = r.render_for(vp, dimension, 0s, &stats);
+
+			THEN("The coarsest pass still covers the whole image") {
+				REQUIRE(image.dimension() == dimension);
+				REQUIRE(stats.primary_rays == 5 * 4);
+				// They only preview the pixels, no sample is kept
+				REQUIRE(stats.samples_per_pixel == 0.0);
+				for (size_t j = 0; j < dimension.height; ++j)
+					for (size_t i = 0; i < dimension.width; ++i) {
+						CAPTURE(i, j);
+						REQUIRE(image.at(i, j)
+								== reference.at(i - i % 8, j - j % 8));
+					}
+			}
+		}
+
+		WHEN("The image is refined pass after pass") {
+			SampleBuffer buffer{dimension};
+			// Past the deadline, every call completes a single pass: the 4
+			// coarse ones, then the first that takes samples
+			while (buffer.passes() < 5)
+				r.refine(vp, buffer, std::chrono::steady_clock::time_point{});
+			REQUIRE(buffer.passes() == 5);
+
+			THEN("Every pixel gets a first sample close to its center") {
+				float error  = 0.f;
+				size_t first = 0;
+				for (size_t j = 0; j < dimension.height; ++j)
+					for (size_t i = 0; i < dimension.width; ++i) {
+						CAPTURE(i, j);
+						REQUIRE(buffer.count(i, j) >= 1);
+						if (buffer.count(i, j) > 1) continue;
+						error += (buffer.mean(i, j) - reference.at(i, j))
+									 .cwiseAbs()
+									 .maxCoeff();
+						++first;
+					}
+				REQUIRE(first == dimension.area());
+				// Apart from the edges, a jittered sample barely differs
+				REQUIRE(error < 0.1f * static_cast<float>(first));
+			}
+
+			AND_WHEN("It goes on long enough") {
+				r.refine(vp,
+						 buffer,
+						 std::chrono::steady_clock::now() + 200ms);
+
+				THEN("Every pixel gets more samples") {
+					REQUIRE(buffer.passes() > 5);
+					REQUIRE(buffer.samples_per_pixel() > 2.0);
+				}
+			}
+		}
+
+		WHEN("Every pixel may stop once converged") {
+			r.set_adaptive_sampling(0.05f);
+			RenderStats stats;
+			const auto start = std::chrono::steady_clock::now();
+			const Framebuffer image = r.render_for(vp, dimension, 60s, &stats);
+
+			THEN("It returns long before the deadline") {
+				REQUIRE(std::chrono::steady_clock::now() - start < 30s);
+				REQUIRE(stats.samples_per_pixel >= 4.0);
+			}
+		}
+
+		WHEN("The samples are kept in a checkpoint file") {
+			const auto checkpoint = std::filesystem::temp_directory_path()
+								  / "progressive_test.samples";
+			r.set_seed(7);
+			Framebuffer image{dimension};
+			std::vector<uint32_t> counts;
+			uint32_t passes = 0;
+			{
+				SampleBuffer buffer{checkpoint, dimension, 7, 8};
+				while (buffer.samples_per_pixel() < 2.0)
+					r.refine(vp,
+							 buffer,
+							 std::chrono::steady_clock::now() + 1ms);
+				image = buffer.image();
+				counts.assign(buffer.counts().begin(), buffer.counts().end());
+				passes = buffer.passes();
+			}
+
+			THEN("It maps back every sample and the pass to go on from") {
+				const SampleBuffer resumed = SampleBuffer::resume(checkpoint);
+				REQUIRE(resumed.dimension() == dimension);
+				REQUIRE(resumed.seed() == 7);
+				REQUIRE(resumed.tile_size() == 8);
+				REQUIRE(resumed.passes() == passes);
+				REQUIRE(std::ranges::equal(resumed.counts(), counts));
+				REQUIRE(resumed.image() == image);
+			}
+
+			AND_WHEN("The render is resumed") {
+				RenderStats stats;
+				const Framebuffer resumed
+					= r.resume(vp, checkpoint, 50ms, &stats);
+
+				THEN("It adds samples on top of those kept") {
+					REQUIRE(resumed.dimension() == dimension);
+					REQUIRE(stats.samples_per_pixel >= 2.0);
+				}
+			}
+
+			AND_WHEN("It is resumed with another seed") {
+				r.set_seed(8);
+
+				THEN("It is refused") {
+					REQUIRE_THROWS_AS(r.resume(vp, checkpoint, 50ms),
+									  std::runtime_error);
+				}
+			}
+
+			AND_WHEN("It is resumed with another tile size") {
+				r.set_tile_size(16);
+
+				THEN("It is refused") {
+					REQUIRE_THROWS_AS(r.resume(vp, checkpoint, 50ms),
+									  std::runtime_error);
+				}
+			}
+		}
+	}
+}
+
+SCENARIO("The progressive samples converge to the same image as render()",
+		 "[image_renderer][render][progressive]") {
+	using namespace std::chrono_literals;
+
+	GIVEN("A tiny pixel a quarter off the straight edge of a black sphere") {
+		// Only the top quarter of the pixel misses the sphere
+		auto [dimension, vp, r]
+			= test::make_edge_scene(Point3f{0, test::EDGE - 0.25e-3f, -1});
+		// Every pixel stops after exactly 2 samples
+		r.set_adaptive_sampling(100.f, 2);
+
+		WHEN("It is refined with many seeds") {
+			constexpr int SEED_COUNT = 256;
+			float coverage           = 0.f;
+			for (int seed = 0; seed < SEED_COUNT; ++seed) {
+				r.set_seed(seed);
+				RenderStats stats;
+				coverage += r.render_for(vp, dimension, 10s, &stats)
+								.at(0, 0)
+								.x();
+				REQUIRE(stats.samples_per_pixel == 2.0);
+			}
+			coverage /= SEED_COUNT;
+
+			THEN("A quarter of them miss it, none goes through the center") {
+				CAPTURE(coverage);
+				REQUIRE(std::abs(coverage - 0.25f) < 0.05f);
+			}
+		}
+	}
+}
+} // namespace raytracing
@@ -0,0 +1,166 @@
+#include "framebuffer.hpp"
+#include "image_renderer.hpp"
+#include "material.hpp"
+#include "render_stats.hpp"
+#include "scenes.hpp"
+#include "sphere.hpp"
+
+#include <algorithm>
+#include <catch2/catch_test_macros.hpp>
+#include <memory>
+
+namespace raytracing {
+SCENARIO("render() does not depend on how the image is split",
+		 "[image_renderer][render]") {
+	GIVEN("A scene of a ground sphere and a glass sphere") {
+		auto [dimension, vp, r] = test::make_glass_scene(Rect{64, 48});
+
+		WHEN("It is rendered serially and on several threads") {
+			r.set_thread_count(1);
+			r.set_tile_size(dimension.width);
+			const Framebuffer serial = r.render(vp, dimension);
+
+			r.set_thread_count(3);
+			r.set_tile_size(7);
+			const Framebuffer tiled = r.render(vp, dimension);
+
+			THEN("Both images are identical") {
+				REQUIRE(serial.dimension() == dimension);
+				REQUIRE(serial == tiled);
+			}
+		}
+
+		WHEN("Every pixel is also traced depth-first by trace_ray()") {
+			const Framebuffer image = r.render(vp, dimension);
+
+			THEN("Both colors agree up to rounding") {
+				for (size_t j = 0; j < dimension.height; ++j)
+					for (size_t i = 0; i < dimension.width; ++i) {
+						const ScaledColor expected
+							= r.trace_ray(r.get_ray(vp, i, j));
+						CAPTURE(i, j, expected, image.at(i, j));
+						REQUIRE(image.at(i, j).isApprox(expected, 1e-5f));
+					}
+			}
+		}
+	}
+}
+
+SCENARIO("Russian roulette leaves the image unbiased",
+		 "[image_renderer][render][culling]") {
+	GIVEN("A glass sphere in front of a mirror") {
+		auto [dimension, vp, r] = test::make_empty_scene(Rect{32, 24}, 8);
+		r.add(std::make_unique<Sphere>(
+			Point3f{0, -100, 0},
+			Material{ScaledColor(0, 0.3, 0.5), 1, 0.9, 1.3},
+			100));
+		r.add(std::make_unique<Sphere>(
+			Point3f{0, 1, 0},
+			Material{ScaledColor(0.5, 0.6, 0.8), 0.1, 0.65, 1.6},
+			1.0));
+		r.set_light_sources(
+			{LightSource{Point3f{0, 5, 0}, ScaledColor{1, 1, 1}}});
+		r.set_tile_size(8);
+
+		const auto mean = [](const Framebuffer &image) {
+			ScaledColor sum = ScaledColor::Zero();
+			for (const auto &pixel : image.pixels()) sum += pixel;
+			return (sum / static_cast<float>(image.pixels().size())).eval();
+		};
+
+		WHEN("The average of many seeds is compared with no culling at all") {
+			r.set_branch_culling(BranchCulling::NONE);
+			const ScaledColor expected = mean(r.render(vp, dimension));
+
+			r.set_branch_culling(BranchCulling::RUSSIAN_ROULETTE);
+			constexpr int SEED_COUNT = 32;
+			ScaledColor average      = ScaledColor::Zero();
+			for (int seed = 0; seed < SEED_COUNT; ++seed) {
+				r.set_seed(seed);
+				average += mean(r.render(vp, dimension)) / SEED_COUNT;
+			}
+
+			THEN("They agree") {
+				CAPTURE(expected, average);
+				REQUIRE(average.isApprox(expected, 1e-2f));
+			}
+		}
+
+		WHEN("The roulette is played on other tiles and threads") {
+			r.set_branch_culling(BranchCulling::RUSSIAN_ROULETTE);
+			r.set_seed(7);
+			r.set_thread_count(1);
+			const Framebuffer image = r.render(vp, dimension);
+			r.set_tile_size(5);
+			r.set_thread_count(3);
+
+			THEN("Every branch survives or not as before") {
+				REQUIRE(r.render(vp, dimension) == image);
+			}
+		}
+
+		WHEN("Every pixel is also traced depth-first by trace_ray()") {
+			r.set_branch_culling(BranchCulling::RUSSIAN_ROULETTE);
+			r.set_seed(7);
+			const Framebuffer image = r.render(vp, dimension);
+
+			THEN("The same branches are culled, the colors agree") {
+				for (size_t j = 0; j < dimension.height; ++j)
+					for (size_t i = 0; i < dimension.width; ++i) {
+						const auto pixel
+							= static_cast<uint32_t>(j * dimension.width + i);
+						const ScaledColor expected
+							= r.trace_ray(r.get_ray(vp, i, j), pixel);
+						CAPTURE(i, j, expected, image.at(i, j));
+						REQUIRE(image.at(i, j).isApprox(expected, 1e-5f));
+					}
+			}
+		}
+
+		WHEN("Branches under the threshold are culled") {
+			r.set_branch_culling(BranchCulling::NONE);
+			const ScaledColor expected = mean(r.render(vp, dimension));
+			r.set_branch_culling(BranchCulling::THRESHOLD);
+
+			THEN("The image barely changes") {
+				const ScaledColor actual = mean(r.render(vp, dimension));
+				REQUIRE(actual.isApprox(expected, 1e-2f));
+			}
+		}
+	}
+}
+SCENARIO("The wavefronts stay bounded however the branches multiply",
+		 "[image_renderer][render][culling]") {
+	GIVEN("A glass sphere inside a mirror sphere, both around the camera") {
+		auto [dimension, vp, r] = test::make_empty_scene(Rect{32, 24}, 12);
+		r.emplace<Sphere>(Point3f::Zero(),
+						  Material{ScaledColor(0.5, 0.6, 0.8), 0.1, 0.5, 1.6},
+						  20.f);
+		r.emplace<Sphere>(Point3f::Zero(),
+						  Material{ScaledColor(0.9, 0.9, 0.9), 0.1, 1, 1.3},
+						  30.f);
+		r.set_branch_culling(BranchCulling::NONE);
+		// A single tile, whose primary rays fit in a wavefront
+		r.set_tile_size(dimension.width);
+
+		WHEN("It is rendered") {
+			RenderStats stats;
+			const Framebuffer image = r.render(vp, dimension, &stats);
+
+			THEN("A bounce takes several wavefronts, the colors still agree "
+				 "with trace_ray()") {
+				CAPTURE(stats.depth_histogram);
+				REQUIRE(std::ranges::max(stats.depth_histogram)
+						> ImageRenderer::MAX_WAVEFRONT);
+				for (size_t j = 0; j < dimension.height; ++j)
+					for (size_t i = 0; i < dimension.width; ++i) {
+						const ScaledColor expected
+							= r.trace_ray(r.get_ray(vp, i, j));
+						CAPTURE(i, j, expected, image.at(i, j));
+						REQUIRE(image.at(i, j).isApprox(expected, 1e-4f));
+					}
+			}
+		}
+	}
+}
+} // namespace raytracing
@@ -0,0 +1,67 @@
+#include "image_renderer.hpp"
+#include "render_stats.hpp"
+#include "scenes.hpp"
+
+#include <catch2/catch_test_macros.hpp>
+#include <numeric>
+
+namespace raytracing {
+SCENARIO("render() reports how many rays it traced",
+		 "[image_renderer][stats]") {
+	GIVEN("A lit scene of a ground sphere and a glass sphere") {
+		auto [dimension, vp, r] = test::make_glass_scene(Rect{40, 30});
+
+		WHEN("It is rendered with and without a BVH, on several tiles") {
+			r.set_thread_count(1);
+			r.set_tile_size(dimension.width);
+			RenderStats serial;
+			(void)r.render(vp, dimension, &serial);
+
+			r.set_thread_count(3);
+			r.set_tile_size(7);
+			RenderStats tiled;
+			(void)r.render(vp, dimension, &tiled);
+
+			r.build_bvh();
+			RenderStats bvh;
+			(void)r.render(vp, dimension, &bvh);
+
+			THEN("Every primary ray and every bounce is counted") {
+				REQUIRE(serial.primary_rays == dimension.area());
+				REQUIRE(serial.depth_histogram[0] == serial.primary_rays);
+				REQUIRE(serial.secondary_rays
+						== std::accumulate(serial.depth_histogram.begin() + 1,
+										   serial.depth_histogram.end(),
+										   uint64_t{0}));
+				REQUIRE(serial.shadow_rays > 0);
+				REQUIRE(serial.early_terminations > 0);
+				REQUIRE(serial.bvh_node_visits == 0);
+				REQUIRE(serial.seconds > 0.0);
+			}
+
+			THEN("The counts do not depend on the tiles") {
+				REQUIRE(tiled.primary_rays == serial.primary_rays);
+				REQUIRE(tiled.secondary_rays == serial.secondary_rays);
+				REQUIRE(tiled.shadow_rays == serial.shadow_rays);
+				REQUIRE(tiled.primitive_tests == serial.primitive_tests);
+				REQUIRE(tiled.depth_histogram == serial.depth_histogram);
+			}
+
+			THEN("The BVH traces the same rays with other tests") {
+				REQUIRE(bvh.total_rays() == serial.total_rays());
+				REQUIRE(bvh.bvh_node_visits > 0);
+			}
+
+			THEN("The JSON holds every counter") {
+				const std::string json = to_json(serial);
+				REQUIRE(json.find(fmt::format("\"primary_rays\": {}",
+											  serial.primary_rays))
+						!= std::string::npos);
+				REQUIRE(json.find("\"depth_histogram\": [1200, ")
+						!= std::string::npos);
+				REQUIRE(json.find("\"mrays_per_second\"") != std::string::npos);
+			}
+		}
+	}
+}
+} // namespace raytracing
@@ -0,0 +1,68 @@
+#include "random.hpp"
+#include "thread_pool.hpp"
+
+#include <array>
+#include <catch2/catch_test_macros.hpp>
+#include <vector>
+
+namespace raytracing {
+TEST_CASE("Rng::philox() matches the Random123 known answers", "[random]") {
+	// kat_vectors of Random123 for philox4x32 with 10 rounds
+	REQUIRE(Rng::philox({0, 0, 0, 0}, {0, 0})
+			== Rng::Counter{0x6627e8d5, 0xe169c58d, 0xbc57ac4c, 0x9b00dbd8});
+	REQUIRE(Rng::philox({0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff},
+						{0xffffffff, 0xffffffff})
+			== Rng::Counter{0x408f276d, 0x41c83b0e, 0xa20bc7c6, 0x6d5451fd});
+	REQUIRE(Rng::philox({0x243f6a88, 0x85a308d3, 0x13198a2e, 0x03707344},
+						{0xa4093822, 0x299f31d0})
+			== Rng::Counter{0xd16cfe09, 0x94fdcceb, 0x5001e420, 0x24126ea1});
+}
+
+SCENARIO("Every sample of every pixel has its own reproducible numbers",
+		 "[random]") {
+	GIVEN("Generators seeded for a few pixels and samples") {
+		constexpr uint64_t SEED = 1234;
+
+		THEN("The same pixel and sample give the same numbers") {
+			Rng lhs{SEED, 17, 3}, rhs{SEED, 17, 3};
+			for (int i = 0; i < 100; ++i)
+				REQUIRE(lhs.next_uint() == rhs.next_uint());
+		}
+
+		THEN("Another pixel, sample or seed gives other numbers") {
+			const uint32_t first = Rng{SEED, 17, 3}.next_uint();
+			REQUIRE(Rng{SEED, 18, 3}.next_uint() != first);
+			REQUIRE(Rng{SEED, 17, 4}.next_uint() != first);
+			REQUIRE(Rng{SEED + 1, 17, 3}.next_uint() != first);
+		}
+
+		THEN("fill() draws the next blocks, in the range asked for") {
+			Rng batch{SEED, 5, 0}, single{SEED, 5, 0};
+			std::array<float, 37> numbers{};
+			batch.fill(numbers, -2.f, 3.f);
+			for (const float x : numbers) {
+				REQUIRE(x == single.uniform(-2.f, 3.f));
+				REQUIRE(-2.f <= x);
+				REQUIRE(x < 3.f);
+			}
+		}
+	}
+
+	GIVEN("Every thread of a pool seeding its generator per pixel") {
+		ThreadPool pool{4};
+		std::vector<Vector3f> serial(1000), parallel(1000);
+		for (uint32_t pixel = 0; pixel < serial.size(); ++pixel) {
+			seed_thread_rng(99, pixel, 0);
+			serial[pixel] = random_unit_vector();
+		}
+		pool.parallel_for(parallel.size(), [&](size_t pixel) {
+			seed_thread_rng(99, static_cast<uint32_t>(pixel), 0);
+			parallel[pixel] = random_unit_vector();
+		});
+
+		THEN("The numbers do not depend on the thread") {
+			REQUIRE(serial == parallel);
+		}
+	}
+}
+} // namespace raytracing
@@ -0,0 +1,89 @@
+#ifndef TEST_SCENES_HPP
+#define TEST_SCENES_HPP
+
+#include "camera.hpp"
+#include "image_renderer.hpp"
+#include "light_source.hpp"
+#include "material.hpp"
+#include "point3f.hpp"
+#include "quantity.hpp"
+#include "rect.hpp"
+#include "sphere.hpp"
+#include "vector3f.hpp"
+#include "viewport.hpp"
+
+#include <cmath>
+#include <cstdint>
+#include <random>
+
+namespace raytracing::test {
+/**
+ * \brief A scene ready to render, with the camera it is seen from.
+ */
+struct Scene {
+	Rect dimension;
+	Viewport viewport;
+	ImageRenderer renderer;
+};
+
+/**
+ * \brief Returns a scene without any object yet, seen from (13, 2, 3) toward
+ * the origin, whose rays bounce up to \a bounce_limit times.
+ */
+inline Scene make_empty_scene(Rect dimension, uint8_t bounce_limit = 5) {
+	using mp_units::angular::unit_symbols::deg;
+
+	Camera cam;
+	cam.perspective(20.f * deg, dimension.aspect_ratio(), 0.1f, 10.f);
+	cam.set_position(Point3f{13, 2, 3});
+	cam.update_view_matrix();
+	return {dimension,
+			cam.set_viewport(dimension),
+			ImageRenderer{cam.orig(), 1, bounce_limit}};
+}
+
+/**
+ * \brief Returns the scene most tests render: a glass sphere on a ground
+ * sphere, lit from above.
+ */
+inline Scene make_glass_scene(Rect dimension) {
+	Scene scene      = make_empty_scene(dimension);
+	ImageRenderer &r = scene.renderer;
+	r.emplace<Sphere>(Point3f{0, -100, 0},
+					  Material{ScaledColor(0, 0.3, 0.5), 1, 0, 1.3},
+					  100.f);
+	r.emplace<Sphere>(Point3f{0, 1, 0},
+					  Material{ScaledColor(0.5, 0.6, 0.8), 0.3, 0.65, 1.6},
+					  1.f);
+	r.set_light_sources({LightSource{Point3f{0, 5, 0}, ScaledColor{1, 1, 1}}});
+	return scene;
+}
+
+// The tangent of the angle under which the sphere of make_edge_scene() is seen
+inline const float EDGE = 0.1f / std::sqrt(0.99f);
+
+/**
+ * \brief Returns a single tiny pixel centered on \a center, a point of the
+ * plane z = -1 seen from the origin, and a black sphere of radius 1 at a
+ * distance of 10 whose edge lies at EDGE.
+ *
+ * Every sample is either black or the white background, so the pixel is the
+ * share of its samples missing the sphere.
+ */
+inline Scene make_edge_scene(Point3fConstRef center) {
+	Scene scene{Rect{1, 1},
+				Viewport{Vector3f{1e-3f, 0, 0}, Vector3f{0, -1e-3f, 0}, center},
+				ImageRenderer{Point3f::Zero(), 1, 5}};
+	scene.renderer.emplace<Sphere>(Point3f{0, 0, -10},
+								   Material{ScaledColor::Zero(), 1, 0, 1.5},
+								   1.f);
+	return scene;
+}
+
+// Returns a point uniformly distributed in [from, upto) on every axis
+inline Vector3f random_point(std::mt19937 &gen, float from, float upto) {
+	std::uniform_real_distribution<float> dist{from, upto};
+	return Vector3f::NullaryExpr([&] { return dist(gen); });
+}
+} // namespace raytracing::test
+#endif /* ifndef TEST_SCENES_HPP */
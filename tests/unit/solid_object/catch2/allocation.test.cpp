@@ -0,0 +1,67 @@
+#include "material.hpp"
+#include "point3f.hpp"
+#include "ray.hpp"
+#include "solid_object_list.hpp"
+#include "sphere.hpp"
+#include "vector3f.hpp"
+
+#include <atomic>
+#include <catch2/catch_test_macros.hpp>
+#include <cstdlib>
+#include <new>
+
+namespace {
+// Counts every allocation made through the global operator new of this test
+// binary, so that a query can be checked to never reach the heap.
+std::atomic<size_t> allocation_count = 0;
+} // namespace
+
+void *operator new(size_t size) {
+	++allocation_count;
+	if (void *p = std::malloc(size == 0 ? 1 : size)) return p;
+	throw std::bad_alloc{};
+}
+
+void operator delete(void *p) noexcept { std::free(p); }
+
+void operator delete(void *p, size_t /*size*/) noexcept { std::free(p); }
+
+namespace raytracing {
+SCENARIO("Ray queries on a SolidObjectList never allocate",
+		 "[solid_object_list][intersection][allocation]") {
+	GIVEN("A list of spheres and rays that hit and miss them") {
+		SolidObjectList world;
+		for (int i = 0; i < 100; ++i)
+			world.insert(std::make_unique<Sphere>(
+				Point3f{float(i % 10) - 5, float(i / 10) - 5, 0},
+				Material{},
+				0.4f));
+		const Ray hit{Point3f{0, 0, 10}, Vector3f{0, 0, -1}};
+		const Ray miss{Point3f{0, 0, 10}, Vector3f{0, 0, 1}};
+
+		const auto count_allocations = [&] {
+			const size_t before = allocation_count;
+			for (const auto &r : {hit, miss}) {
+				[[maybe_unused]] auto closest = world.find_closest_hit(r);
+				[[maybe_unused]] auto intersection
+					= world.find_closest_intersection(r);
+				[[maybe_unused]] bool occluded = world.is_occluded(r, 100.f);
+			}
+			return allocation_count - before;
+		};
+
+		THEN("The brute-force search does not allocate") {
+			REQUIRE(world.find_closest_hit(hit).has_value());
+			REQUIRE_FALSE(world.find_closest_hit(miss).has_value());
+			REQUIRE(count_allocations() == 0);
+		}
+
+		WHEN("A BVH is built over the objects") {
+			world.build_bvh();
+			THEN("Traversing it does not allocate either") {
+				REQUIRE(count_allocations() == 0);
+			}
+		}
+	}
+}
+} // namespace raytracing
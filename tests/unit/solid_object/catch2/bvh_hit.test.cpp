@@ -0,0 +1,299 @@
+#include "bvh.hpp"
+#include "material.hpp"
+#include "point3f.hpp"
+#include "ray.hpp"
+#include "scenes.hpp"
+#include "solid_object_list.hpp"
+#include "sphere.hpp"
+#include "vector3f.hpp"
+
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/generators/catch_generators.hpp>
+#include <cmath>
+#include <numeric>
+#include <optional>
+#include <random>
+#include <vector>
+
+namespace raytracing {
+using test::random_point;
+
+SCENARIO("The BVH finds the same intersections as the brute-force search",
+		 "[solid_object_list][bvh][intersection]") {
+	GIVEN("A ground sphere and a cloud of small overlapping spheres") {
+		// A fixed seed keeps the scene, and any failure, reproducible
+		std::mt19937 gen{42};
+		SolidObjectList world;
+		world.insert(std::make_unique<Sphere>(Point3f{0, -100, 0},
+											  Material{},
+											  100));
+		for (int i = 0; i < 2000; ++i)
+			world.insert(std::make_unique<Sphere>(
+				random_point(gen, -20, 20),
+				Material{},
+				std::uniform_real_distribution<float>{0.05f, 1.f}(gen)));
+		// An exact duplicate, the first one must keep winning ties
+		world.insert(std::make_unique<Sphere>(Point3f{0, 1, 0}, Material{}, 1));
+		world.insert(std::make_unique<Sphere>(Point3f{0, 1, 0}, Material{}, 1));
+
+		std::vector<Ray> rays;
+		for (int i = 0; i < 2000; ++i)
+			rays.push_back({random_point(gen, -30, 30),
+							random_point(gen, -1, 1)});
+		rays.push_back({Point3f{0, 1, 10}, Vector3f{0, 0, -1}});
+
+		std::vector<std::optional<Intersection>> expected;
+		for (const auto &r : rays)
+			expected.push_back(world.find_closest_intersection(r));
+
+		WHEN("A BVH is built over the objects") {
+			const auto builder = GENERATE(BvhBuilder::SWEEP_SAH,
+										  BvhBuilder::BINNED_SAH,
+										  BvhBuilder::LBVH);
+			const auto layout  = GENERATE(BvhLayout::BINARY,
+										  BvhLayout::BVH4,
+										  BvhLayout::BVH8);
+			world.build_bvh(builder, layout);
+			REQUIRE(world.has_bvh());
+
+			THEN("Every ray hits the same object at the same point") {
+				for (size_t i = 0; i < rays.size(); ++i) {
+					const auto actual
+						= world.find_closest_intersection(rays[i]);
+					CAPTURE(i);
+					REQUIRE(actual.has_value() == expected[i].has_value());
+					if (!actual.has_value()) continue;
+					REQUIRE(actual->material == expected[i]->material);
+					REQUIRE(actual->position == expected[i]->position);
+				}
+			}
+
+			AND_WHEN("Another object is inserted") {
+				world.insert(
+					std::make_unique<Sphere>(Point3f{0, 0, 0}, Material{}, 1));
+				THEN("The BVH is dropped") { REQUIRE_FALSE(world.has_bvh()); }
+			}
+		}
+	}
+}
+
+SCENARIO("The BVH and the brute-force search agree on occlusion",
+		 "[solid_object_list][bvh][shadow]") {
+	GIVEN("A cloud of small spheres and shadow rays of random lengths") {
+		std::mt19937 gen{7};
+		SolidObjectList world;
+		for (int i = 0; i < 1000; ++i)
+			world.insert(std::make_unique<Sphere>(random_point(gen, -10, 10),
+												  Material{},
+												  0.3f));
+
+		std::vector<std::pair<Ray, float>> shadow_rays;
+		for (int i = 0; i < 2000; ++i) {
+			const Vector3f from = random_point(gen, -12, 12);
+			const Vector3f to   = random_point(gen, -12, 12);
+			shadow_rays.emplace_back(Ray{from, (to - from).normalized()},
+									 (to - from).norm());
+		}
+
+		std::vector<bool> expected;
+		for (const auto &[r, t_max] : shadow_rays)
+			expected.push_back(world.is_occluded(r, t_max));
+
+		WHEN("A BVH is built over the objects") {
+			const auto builder = GENERATE(BvhBuilder::SWEEP_SAH,
+										  BvhBuilder::BINNED_SAH,
+										  BvhBuilder::LBVH);
+			const auto layout  = GENERATE(BvhLayout::BINARY,
+										  BvhLayout::BVH4,
+										  BvhLayout::BVH8);
+			world.build_bvh(builder, layout);
+
+			THEN("Every shadow ray is blocked or not just the same") {
+				for (size_t i = 0; i < shadow_rays.size(); ++i) {
+					const auto &[r, t_max] = shadow_rays[i];
+					CAPTURE(i);
+					REQUIRE(world.is_occluded(r, t_max) == expected[i]);
+				}
+			}
+		}
+
+		AND_GIVEN("A single sphere 4 units ahead of a ray") {
+			SolidObjectList single;
+			single.insert(
+				std::make_unique<Sphere>(Point3f{0, 0, -5}, Material{}, 1));
+			const Ray r{Point3f::Zero(), -Vector3f::UnitZ()};
+
+			THEN("It is occluded only once t_max reaches the sphere") {
+				REQUIRE(single.is_occluded(r, 4.5f));
+				REQUIRE_FALSE(single.is_occluded(r, 3.5f));
+			}
+
+			WHEN("A BVH of a single leaf is built over it") {
+				single.build_bvh(BvhBuilder::BINNED_SAH,
+								 GENERATE(BvhLayout::BINARY,
+										  BvhLayout::BVH4,
+										  BvhLayout::BVH8));
+
+				THEN("The sphere is still found") {
+					REQUIRE(single.is_occluded(r, 4.5f));
+					REQUIRE_FALSE(single.is_occluded(r, 3.5f));
+					REQUIRE(single.find_closest_hit(r).has_value());
+				}
+			}
+		}
+	}
+}
+SCENARIO("The parallel builders give the same tree on any number of threads",
+		 "[bvh][build]") {
+	GIVEN("Enough spheres for the builders to share every step") {
+		std::mt19937 gen{3};
+		std::vector<Sphere> spheres;
+		for (int i = 0; i < 20000; ++i)
+			spheres.emplace_back(random_point(gen, -40, 40), Material{}, 0.5f);
+		std::vector<const SolidObject *> solids;
+		for (const auto &sphere : spheres) solids.push_back(&sphere);
+
+		std::vector<Ray> rays;
+		for (int i = 0; i < 500; ++i)
+			rays.push_back({random_point(gen, -50, 50),
+							random_point(gen, -1, 1).normalized()});
+
+		WHEN("A tree is built on one thread and on several") {
+			const auto builder
+				= GENERATE(BvhBuilder::BINNED_SAH, BvhBuilder::LBVH);
+			const Bvh serial{solids, builder, BvhLayout::BINARY, 1};
+			const Bvh parallel{solids, builder, BvhLayout::BINARY, 4};
+
+			THEN("Both trees are the same") {
+				REQUIRE(parallel.node_count() == serial.node_count());
+				REQUIRE(parallel.sah_cost() == serial.sah_cost());
+				REQUIRE(parallel.sah_cost() > 0.f);
+			}
+
+			THEN("Every ray hits the same object as the brute-force search") {
+				for (size_t i = 0; i < rays.size(); ++i) {
+					std::optional<Bvh::Hit> expected;
+					for (size_t k = 0; k < solids.size(); ++k) {
+						const float root = solids[k]->hit(rays[i]);
+						if (!std::isinf(root)
+							&& (!expected || root < expected->root))
+							expected = Bvh::Hit{k, root};
+					}
+					const auto actual = parallel.find_closest_hit(rays[i]);
+					CAPTURE(i);
+					REQUIRE(actual.has_value() == expected.has_value());
+					if (!actual.has_value()) continue;
+					REQUIRE(actual->index == expected->index);
+					REQUIRE(actual->root == expected->root);
+				}
+			}
+		}
+	}
+}
+
+SCENARIO("A refitted BVH finds the objects where they moved",
+		 "[solid_object_list][bvh][refit]") {
+	GIVEN("The same cloud of spheres with and without a BVH") {
+		std::mt19937 gen{11};
+		SolidObjectList world, plain;
+		for (int i = 0; i < 3000; ++i) {
+			const Point3f center = random_point(gen, -20, 20);
+			world.emplace<Sphere>(center, Material{}, 0.5f);
+			plain.emplace<Sphere>(center, Material{}, 0.5f);
+		}
+		const auto layout = GENERATE(BvhLayout::BINARY,
+									 BvhLayout::BVH4,
+									 BvhLayout::BVH8);
+		world.build_bvh(BvhBuilder::BINNED_SAH, layout);
+
+		std::vector<Ray> rays;
+		for (int i = 0; i < 2000; ++i)
+			rays.push_back({random_point(gen, -30, 30),
+							random_point(gen, -1, 1).normalized()});
+
+		WHEN("Every seventh sphere moves in both and the BVH is refitted") {
+			for (size_t id = 0; id < world.size(); id += 7) {
+				const Vector3f displacement = random_point(gen, -2, 2);
+				const auto move = [&](SolidObject &solid) {
+					solid.translate(displacement);
+				};
+				world.transform(id, move);
+				plain.transform(id, move);
+			}
+			REQUIRE_FALSE(world.refit_bvh());
+
+			THEN("Every ray hits the same sphere at the same root") {
+				for (size_t i = 0; i < rays.size(); ++i) {
+					const auto actual   = world.find_closest_hit(rays[i]);
+					const auto expected = plain.find_closest_hit(rays[i]);
+					CAPTURE(i);
+					REQUIRE(actual.has_value() == expected.has_value());
+					if (!actual.has_value()) continue;
+					REQUIRE(actual->object_id == expected->object_id);
+					REQUIRE(actual->root == expected->root);
+					REQUIRE(world.is_occluded(rays[i], actual->root + 0.1f));
+				}
+			}
+		}
+	}
+}
+
+SCENARIO("Refitting tracks the SAH cost and rebuilds a degraded tree",
+		 "[bvh][refit]") {
+	GIVEN("A BVH over a cloud of spheres") {
+		std::mt19937 gen{5};
+		std::vector<Sphere> spheres;
+		for (int i = 0; i < 20000; ++i)
+			spheres.emplace_back(random_point(gen, -40, 40), Material{}, 0.5f);
+		std::vector<const SolidObject *> solids;
+		for (const auto &sphere : spheres) solids.push_back(&sphere);
+		std::vector<uint32_t> all(spheres.size());
+		std::iota(all.begin(), all.end(), 0U);
+
+		const auto layout = GENERATE(BvhLayout::BINARY, BvhLayout::BVH8);
+		Bvh serial{solids, BvhBuilder::BINNED_SAH, layout, 1};
+		Bvh parallel{solids, BvhBuilder::BINNED_SAH, layout, 4};
+		REQUIRE(serial.sah_cost() == serial.built_sah_cost());
+
+		WHEN("Every sphere jitters a little") {
+			for (auto &sphere : spheres)
+				sphere.translate(random_point(gen, -0.2f, 0.2f)).apply();
+
+			THEN("Both trees are refitted the same, not rebuilt") {
+				REQUIRE_FALSE(serial.refit(all, 1.5f, 1));
+				REQUIRE_FALSE(parallel.refit(all, 1.5f, 4));
+				REQUIRE(serial.sah_cost() == parallel.sah_cost());
+				REQUIRE(serial.sah_cost() != serial.built_sah_cost());
+			}
+		}
+
+		WHEN("Every sphere moves anywhere else in the cloud") {
+			for (auto &sphere : spheres)
+				sphere
+					.translate(random_point(gen, -40, 40) - sphere.center())
+					.apply();
+
+			THEN("The tree is rebuilt, as good as new") {
+				REQUIRE(parallel.refit(all, 1.5f, 4));
+				REQUIRE(parallel.sah_cost() == parallel.built_sah_cost());
+				for (int i = 0; i < 200; ++i) {
+					const Ray ray{random_point(gen, -50, 50),
+								  random_point(gen, -1, 1).normalized()};
+					std::optional<Bvh::Hit> expected;
+					for (size_t k = 0; k < solids.size(); ++k) {
+						const float root = solids[k]->hit(ray);
+						if (!std::isinf(root)
+							&& (!expected || root < expected->root))
+							expected = Bvh::Hit{k, root};
+					}
+					const auto actual = parallel.find_closest_hit(ray);
+					CAPTURE(i);
+					REQUIRE(actual.has_value() == expected.has_value());
+					if (actual.has_value())
+						REQUIRE(actual->index == expected->index);
+				}
+			}
+		}
+	}
+}
+} // namespace raytracing
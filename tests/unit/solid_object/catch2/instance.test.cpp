@@ -0,0 +1,143 @@
+#include "instance.hpp"
+#include "material.hpp"
+#include "point3f.hpp"
+#include "prototype.hpp"
+#include "ray.hpp"
+#include "render_stats.hpp"
+#include "scenes.hpp"
+#include "solid_object_list.hpp"
+#include "sphere.hpp"
+#include "vector3f.hpp"
+
+#include <Eigen/Geometry>
+#include <catch2/catch_test_macros.hpp>
+#include <memory>
+#include <random>
+#include <vector>
+
+namespace raytracing {
+namespace {
+using test::random_point;
+
+struct Part {
+	Point3f center;
+	float radius;
+	float refractive_index;
+};
+} // namespace
+
+SCENARIO("An instance hits like a transformed copy of its prototype",
+		 "[solid_object][instance]") {
+	GIVEN("A prototype of three spheres, and their copies transformed") {
+		const std::vector<Part> parts{{Point3f{0, 0, 0}, 1.f, 1.3f},
+									  {Point3f{1.5f, 0.5f, 0}, 0.6f, 1.5f},
+									  {Point3f{-1, 1, 0.5f}, 0.4f, 1.7f}};
+		SolidObjectList prototype_parts;
+		for (const auto &part : parts)
+			prototype_parts.emplace<Sphere>(
+				part.center,
+				Material{{}, 1.f, 1.f, part.refractive_index},
+				part.radius);
+		const auto prototype
+			= std::make_shared<const Prototype>(std::move(prototype_parts));
+
+		const Eigen::AffineCompact3f transform
+			= Eigen::Translation3f{5, 1, -3}
+			* Eigen::AngleAxisf{0.7f, Vector3f{1, 2, 0.5f}.normalized()}
+			* Eigen::Scaling(2.f);
+		SolidObjectList copies;
+		for (const auto &part : parts)
+			copies.emplace<Sphere>(
+				transform * part.center,
+				Material{{}, 1.f, 1.f, part.refractive_index},
+				2.f * part.radius);
+
+		SolidObjectList instances;
+		instances.emplace<Instance>(prototype, transform);
+		instances.build_bvh();
+
+		std::mt19937 gen{17};
+		std::vector<Ray> rays;
+		for (int i = 0; i < 2000; ++i) {
+			const Point3f origin = random_point(gen, -10, 10);
+			const Point3f target = Point3f{5, 1, -3} + random_point(gen, -4, 4);
+			rays.push_back({origin, (target - origin).normalized()});
+		}
+
+		THEN("Every ray hits the same part at the same point") {
+			for (size_t i = 0; i < rays.size(); ++i) {
+				const Ray &ray      = rays[i];
+				const auto actual   = instances.find_closest_intersection(ray);
+				const auto expected = copies.find_closest_intersection(ray);
+				CAPTURE(i);
+				REQUIRE(actual.has_value() == expected.has_value());
+				if (!actual.has_value()) continue;
+				REQUIRE(*actual == *expected);
+				REQUIRE(actual->material->get_refractive_index()
+						== expected->material->get_refractive_index());
+			}
+		}
+
+		THEN("The search counts the tests of the parts, not just one") {
+			const Ray ray{Point3f{5, 1, 10}, Vector3f{0, 0, -1}};
+			TraversalStats stats;
+			REQUIRE(instances.find_closest_hit(ray, &stats).has_value());
+			// The instance in the scene, then at least one of its parts
+			REQUIRE(stats.primitive_tests >= 2);
+			REQUIRE(stats.node_visits >= 2);
+		}
+
+		WHEN("Another instance overrides the material") {
+			const Material glass{{}, 0.f, 0.1f, 1.9f};
+			SolidObjectList overridden;
+			overridden.emplace<Instance>(prototype, transform, glass);
+
+			THEN("Every part it hits has that material") {
+				for (const auto &ray : rays) {
+					const auto hit = overridden.find_closest_intersection(ray);
+					if (hit.has_value())
+						REQUIRE(hit->material->get_refractive_index() == 1.9f);
+				}
+			}
+		}
+	}
+}
+
+SCENARIO("Instances share the geometry of their prototype",
+		 "[solid_object][instance][bvh]") {
+	GIVEN("A field of instances of a single sphere, one every 3 units") {
+		SolidObjectList sphere;
+		sphere.emplace<Sphere>(Point3f::Zero(), Material{}, 1.f);
+		const auto prototype
+			= std::make_shared<const Prototype>(std::move(sphere));
+
+		SolidObjectList field;
+		for (int i = 0; i < 40; ++i)
+			for (int j = 0; j < 25; ++j)
+				field.emplace<Instance>(
+					prototype,
+					Eigen::AffineCompact3f{Eigen::Translation3f{
+						3.f * static_cast<float>(i),
+						0.f,
+						3.f * static_cast<float>(j)}});
+		field.build_bvh();
+
+		THEN("Every instance points to the same prototype") {
+			REQUIRE(prototype.use_count() == 1 + 40 * 25);
+		}
+
+		THEN("A ray down a row hits its first instance") {
+			for (int j = 0; j < 25; ++j) {
+				const Ray ray{Point3f{-5, 0, 3.f * static_cast<float>(j)},
+							  Vector3f::UnitX()};
+				const auto hit = field.find_closest_hit(ray);
+				CAPTURE(j);
+				REQUIRE(hit.has_value());
+				REQUIRE(hit->object_id == static_cast<uint32_t>(j));
+				REQUIRE(hit->to_intersection(ray).normal.isApprox(
+					-Vector3f::UnitX()));
+			}
+		}
+	}
+}
+} // namespace raytracing
@@ -40,7 +40,7 @@ TEST_CASE("find_closest_intersection() function test",
 				THEN("Expect the ray hits the ground") {
 					const Point3f point = intersection->position;
 
-					CAPTURE(world.container(), point);
+					CAPTURE(point);
 
 					REQUIRE(intersection.has_value());
 
@@ -0,0 +1,112 @@
+#include "material.hpp"
+#include "point3f.hpp"
+#include "ray.hpp"
+#include "scenes.hpp"
+#include "solid_object_list.hpp"
+#include "sphere.hpp"
+#include "sphere_store.hpp"
+#include "vector3f.hpp"
+
+#include <catch2/catch_test_macros.hpp>
+#include <random>
+
+namespace raytracing {
+namespace {
+// A type without a bucket, only reachable through the virtual calls
+class PolymorphicSphere final : public SolidObject {
+public:
+	PolymorphicSphere(Point3fConstRef center, const Material &optics,
+					  float radius)
+		: SolidObject(center, optics), radius_(radius) {}
+
+	[[nodiscard]] float hit(const Ray &ray) const override {
+		return intersect_sphere(ray, center(), radius_ * radius_);
+	}
+
+	[[nodiscard]] bool contains(Point3fConstRef point) const override {
+		return displacement_to(point).squaredNorm() <= radius_ * radius_;
+	}
+
+	[[nodiscard]] Vector3f normal_at(Point3fConstRef point) const override {
+		return displacement_to(point).normalized();
+	}
+
+	[[nodiscard]] Eigen::AlignedBox3f bounding_box() const override {
+		return {center().array() - radius_, center().array() + radius_};
+	}
+
+private:
+	float radius_;
+};
+
+using test::random_point;
+} // namespace
+
+SCENARIO("Bucketed and fallback objects are found in insertion order",
+		 "[solid_object_list][bucket][intersection]") {
+	GIVEN("Spheres emplaced, inserted, and of a type without a bucket") {
+		std::mt19937 gen{3};
+		SolidObjectList world;
+		for (int i = 0; i < 300; ++i) {
+			const Point3f center = random_point(gen, -10, 10);
+			const float radius
+				= std::uniform_real_distribution<float>{0.1f, 2.f}(gen);
+			switch (i % 3) {
+			case 0: world.emplace<Sphere>(center, Material{}, radius); break;
+			case 1:
+				world.insert(
+					std::make_unique<Sphere>(center, Material{}, radius));
+				break;
+			default:
+				world.insert(std::make_unique<PolymorphicSphere>(center,
+																 Material{},
+																 radius));
+			}
+		}
+		// The same sphere as every kind, the first one must win ties
+		world.insert(std::make_unique<PolymorphicSphere>(Point3f{0, 0, 0},
+														 Material{},
+														 1));
+		world.emplace<Sphere>(Point3f{0, 0, 0}, Material{}, 1);
+
+		THEN("Every object keeps its index") {
+			REQUIRE(world.size() == 302);
+			REQUIRE(world.fallback_count() == 101);
+		}
+
+		THEN("The closest hit is the first nearest object in insertion "
+			 "order") {
+			for (int i = 0; i < 1000; ++i) {
+				const Ray ray{random_point(gen, -12, 12),
+							  random_point(gen, -1, 1)};
+
+				HitRecord expected;
+				for (size_t id = 0; id < world.size(); ++id)
+					expected.keep_closest(world[id].hit(ray),
+										  static_cast<uint32_t>(id));
+
+				const auto actual = world.find_closest_hit(ray);
+				REQUIRE(actual.has_value() == !std::isinf(expected.root));
+				if (!actual.has_value()) continue;
+				REQUIRE(actual->root == expected.root);
+				REQUIRE(actual->object_id == expected.object_id);
+				REQUIRE(actual->solid == &world[expected.object_id]);
+			}
+		}
+
+		THEN("The primary container is the first object containing the "
+			 "point") {
+			for (int i = 0; i < 1000; ++i) {
+				const Point3f point = random_point(gen, -12, 12);
+
+				const SolidObject *expected = nullptr;
+				for (size_t id = 0; id < world.size() && !expected; ++id)
+					if (world[id].contains(point)) expected = &world[id];
+
+				const auto actual = world.find_any_primary_container(point);
+				REQUIRE(actual.value_or(nullptr) == expected);
+			}
+		}
+	}
+}
+} // namespace raytracing
@@ -0,0 +1,80 @@
+#include "point3f.hpp"
+#include "ray.hpp"
+#include "scenes.hpp"
+#include "sphere_store.hpp"
+#include "vector3f.hpp"
+
+#include <catch2/catch_test_macros.hpp>
+#include <cmath>
+#include <limits>
+#include <random>
+#include <vector>
+
+namespace raytracing {
+namespace {
+struct PackedSphere {
+	Point3f center;
+	float radius;
+};
+
+using test::random_point;
+} // namespace
+
+SCENARIO("The packed spheres give the same roots as one sphere at a time",
+		 "[sphere_store][intersection]") {
+	GIVEN("A number of spheres that is not a multiple of the batch width") {
+		std::mt19937 gen{7};
+		std::vector<PackedSphere> spheres;
+		SphereStore store;
+		for (uint32_t id = 0; id < 37; ++id) {
+			const PackedSphere sphere{
+				random_point(gen, -10, 10),
+				std::uniform_real_distribution<float>{0.1f, 3.f}(gen)};
+			spheres.push_back(sphere);
+			store.push_back(sphere.center, sphere.radius, id);
+		}
+		// An exact duplicate, the first one must keep winning ties
+		spheres.push_back(spheres[3]);
+		store.push_back(spheres[3].center, spheres[3].radius, 37);
+
+		std::vector<Ray> rays;
+		for (int i = 0; i < 1000; ++i)
+			rays.push_back({random_point(gen, -15, 15),
+							random_point(gen, -1, 1)});
+
+		THEN("The closest hit and the shadow query match the scalar loop") {
+			for (const auto &ray : rays) {
+				float root  = std::numeric_limits<float>::infinity();
+				uint32_t id = 0;
+				for (uint32_t i = 0; i < spheres.size(); ++i) {
+					const float x = intersect_sphere(ray,
+													 spheres[i].center,
+													 spheres[i].radius
+														 * spheres[i].radius);
+					if (x < root) {
+						root = x;
+						id   = i;
+					}
+				}
+
+				const auto hit = store.find_closest(ray);
+				REQUIRE(hit.root == root);
+				if (!std::isinf(root)) REQUIRE(hit.id == id);
+
+				REQUIRE(store.any_hit(ray, root * 1.5f) == !std::isinf(root));
+				REQUIRE_FALSE(store.any_hit(ray, root));
+			}
+		}
+	}
+
+	GIVEN("An empty store") {
+		const SphereStore store;
+
+		THEN("Nothing is ever hit") {
+			const Ray ray{Point3f{0, 0, 0}, Vector3f{0, 0, 1}};
+			REQUIRE(std::isinf(store.find_closest(ray).root));
+			REQUIRE_FALSE(store.any_hit(ray, 1e9f));
+		}
+	}
+}
+} // namespace raytracing
@@ -0,0 +1,79 @@
+#include "instance.hpp"
+#include "material.hpp"
+#include "point3f.hpp"
+#include "prototype.hpp"
+#include "quantity.hpp"
+#include "ray.hpp"
+#include "solid_object_list.hpp"
+#include "sphere.hpp"
+#include "vector3f.hpp"
+
+#include <catch2/catch_test_macros.hpp>
+#include <memory>
+
+namespace raytracing {
+SCENARIO("The cached inverse transforms follow the model matrix",
+		 "[solid_object][transform]") {
+	using mp_units::angular::unit_symbols::deg;
+
+	GIVEN("A sphere rotated and translated several times") {
+		Sphere solid{Point3f{1, 2, 3}, Material{}, 1};
+		solid.rotate(30.f * deg, Axis::X)
+			.translate(Vector3f{1, -2, 0.5})
+			.rotate(-75.f * deg, Axis::Z);
+		const Eigen::AffineCompact3f model = solid.object_to_world();
+
+		THEN("The world to object matrix is the inverse of the model one") {
+			REQUIRE(solid.world_to_object().matrix().isApprox(
+				model.inverse().matrix()));
+			REQUIRE(solid.normal_matrix().isApprox(
+				model.linear().inverse().transpose()));
+		}
+
+		WHEN("A ray goes to object coordinates and back") {
+			const Ray camera{Point3f{-3, 4, 1}, Vector3f{0.2, -1, 0.7}};
+			const Ray back = solid.object_to_camera_coordinates(
+				solid.camera_to_object_coordinates(camera));
+
+			THEN("The original ray is recovered") {
+				REQUIRE(back.origin.isApprox(camera.origin));
+				REQUIRE(back.direction.isApprox(camera.direction));
+			}
+		}
+	}
+}
+
+SCENARIO("Every transform moves an object by its own translations only",
+		 "[solid_object][transform]") {
+	GIVEN("A sphere, and an instance of the same sphere, both at the origin") {
+		SolidObjectList sphere;
+		sphere.emplace<Sphere>(Point3f::Zero(), Material{}, 1.f);
+		const auto prototype
+			= std::make_shared<const Prototype>(std::move(sphere));
+
+		SolidObjectList world;
+		world.emplace<Sphere>(Point3f::Zero(), Material{}, 1.f);
+		world.emplace<Instance>(prototype,
+								Eigen::AffineCompact3f::Identity());
+
+		WHEN("Both are translated by the same step, frame after frame") {
+			const Vector3f step{1, 2, 0};
+			for (int frame = 0; frame < 3; ++frame)
+				for (size_t id = 0; id < world.size(); ++id)
+					world.transform(id, [&](SolidObject &solid) {
+						solid.translate(step);
+					});
+
+			THEN("Both are three steps away, and hit alike") {
+				const Ray ray{Point3f{3, 6, 5}, Vector3f{0, 0, -1}};
+				for (size_t id = 0; id < world.size(); ++id) {
+					CAPTURE(id);
+					REQUIRE(world[id].bounding_box().center().isApprox(
+						Point3f{3, 6, 0}));
+					REQUIRE(world[id].hit(ray) == 4.f);
+				}
+			}
+		}
+	}
+}
+} // namespace raytracing
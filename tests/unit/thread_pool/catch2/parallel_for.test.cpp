@@ -0,0 +1,75 @@
+#include "rect.hpp"
+#include "thread_pool.hpp"
+#include "tile.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <catch2/catch_test_macros.hpp>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+namespace raytracing {
+SCENARIO("ThreadPool::parallel_for() runs every task exactly once",
+		 "[thread_pool]") {
+	GIVEN("A pool of 4 threads") {
+		ThreadPool pool{4};
+
+		WHEN("parallel_for() is called twice over 1000 tasks") {
+			std::vector<std::atomic<int>> visits(1000);
+			for (int round = 0; round < 2; ++round)
+				pool.parallel_for(visits.size(),
+								  [&visits](size_t i) { ++visits[i]; });
+
+			THEN("Every task has run once per call") {
+				for (const auto &count : visits) REQUIRE(count == 2);
+			}
+		}
+
+		WHEN("A task throws") {
+			std::atomic<int> running = 0;
+			const auto call          = [&] {
+				pool.parallel_for(1000, [&](size_t i) {
+					++running;
+					if (i == 500) throw std::runtime_error("task 500");
+					std::this_thread::yield();
+					--running;
+				});
+			};
+
+			THEN("It is rethrown once no task runs any more") {
+				REQUIRE_THROWS_AS(call(), std::runtime_error);
+				// Only the task that threw never returned
+				REQUIRE(running == 1);
+			}
+
+			THEN("The pool still runs every task of the next call") {
+				REQUIRE_THROWS_AS(call(), std::runtime_error);
+				std::vector<std::atomic<int>> visits(1000);
+				pool.parallel_for(visits.size(),
+								  [&visits](size_t i) { ++visits[i]; });
+				for (const auto &count : visits) REQUIRE(count == 1);
+			}
+		}
+	}
+}
+
+SCENARIO("split_into_tiles() covers every pixel exactly once", "[tile]") {
+	GIVEN("An image whose sides are not multiples of the tile size") {
+		const Rect image{100, 37};
+		const auto tiles = split_into_tiles(image, 16);
+
+		THEN("The tiles are clipped to the image and do not overlap") {
+			std::vector<int> coverage(image.area());
+			for (const auto &[x, y, width, height] : tiles)
+				for (size_t j = y; j < y + height; ++j)
+					for (size_t i = x; i < x + width; ++i)
+						++coverage[j * image.width + i];
+
+			REQUIRE(tiles.size() == 7 * 3);
+			REQUIRE(std::ranges::all_of(coverage,
+										[](int n) { return n == 1; }));
+		}
+	}
+}
+} // namespace raytracing